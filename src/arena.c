@@ -0,0 +1,61 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void arena_finish(struct arena *arena) {
+    struct arena_chunk *chunk = arena->first;
+    while (chunk != NULL) {
+        struct arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    memset(arena, 0, sizeof(*arena));
+}
+
+static struct arena_chunk *arena_chunk_new(size_t size) {
+    size                      = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+    struct arena_chunk *chunk = malloc(sizeof(*chunk) + size);
+    chunk->next               = NULL;
+    chunk->size               = size;
+    return chunk;
+}
+
+void *arena_alloc(struct arena *arena, size_t size) {
+    size_t align = sizeof(max_align_t);
+    size         = (size + align - 1) / align * align;
+
+    if (arena->chunk == NULL || arena->used + size > arena->chunk->size) {
+        // Reuse the next chunk if it is large enough, otherwise insert a new
+        // one before it.
+        struct arena_chunk *next =
+            arena->chunk != NULL ? arena->chunk->next : arena->first;
+        if (next == NULL || next->size < size) {
+            struct arena_chunk *chunk = arena_chunk_new(size);
+            chunk->next               = next;
+            if (arena->chunk != NULL) {
+                arena->chunk->next = chunk;
+            } else {
+                arena->first = chunk;
+            }
+            next = chunk;
+        }
+
+        arena->chunk = next;
+        arena->used  = 0;
+    }
+
+    void *ptr    = (char *)arena->chunk->data + arena->used;
+    arena->used += size;
+    return memset(ptr, 0, size);
+}
+
+struct arena_mark arena_save(struct arena *arena) {
+    return (struct arena_mark){.chunk = arena->chunk, .used = arena->used};
+}
+
+void arena_release(struct arena *arena, struct arena_mark mark) {
+    arena->chunk = mark.chunk;
+    arena->used  = mark.used;
+}
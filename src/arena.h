@@ -0,0 +1,40 @@
+#ifndef __ARENA_H_INCLUDED__
+#define __ARENA_H_INCLUDED__
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t              size;
+    max_align_t         data[];
+};
+
+/**
+ * A bump allocator whose allocations are released all at once, back to a
+ * mark. Chunks are kept once allocated so that the memory released is reused
+ * by the next allocations. A zeroed arena is empty.
+ */
+struct arena {
+    struct arena_chunk *first;
+    struct arena_chunk *chunk; // the one being allocated from
+    size_t              used;  // bytes used in `chunk`
+};
+
+struct arena_mark {
+    struct arena_chunk *chunk;
+    size_t              used;
+};
+
+void arena_finish(struct arena *arena);
+
+// Returns zeroed memory aligned for any type.
+void *arena_alloc(struct arena *arena, size_t size);
+
+struct arena_mark arena_save(struct arena *arena);
+
+// Releases everything allocated since `mark` was taken.
+void arena_release(struct arena *arena, struct arena_mark mark);
+
+#endif
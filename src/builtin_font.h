@@ -0,0 +1,22 @@
+#ifndef __BUILTIN_FONT_H_INCLUDED__
+#define __BUILTIN_FONT_H_INCLUDED__
+
+#include <cairo.h>
+
+// Font family selecting the builtin font.
+#define BUILTIN_FONT_FAMILY "builtin"
+
+/**
+ * `builtin_font_face_create` returns a 5x7 bitmap font covering printable
+ * ASCII, compiled in so that drawing labels doesn't need fontconfig. Other
+ * characters are drawn as '?'.
+ */
+cairo_font_face_t *builtin_font_face_create(void);
+
+/**
+ * `label_font_face_create` returns the builtin font for `BUILTIN_FONT_FAMILY`
+ * and cairo's toy font face of `family` otherwise.
+ */
+cairo_font_face_t *label_font_face_create(const char *family);
+
+#endif
@@ -3,8 +3,10 @@
 #include "log.h"
 #include "state.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -111,6 +113,103 @@ static int parse_uint8(void *dest, char *value) {
     return 0;
 }
 
+static int parse_buffer_count(void *dest, char *value) {
+    int decoded = atoi(value);
+    if (decoded < 1 || decoded > SURFACE_BUFFER_POOL_MAX_SIZE) {
+        LOG_ERR(
+            "Value should be between 1 and %d (included).",
+            SURFACE_BUFFER_POOL_MAX_SIZE
+        );
+        return 1;
+    }
+
+    *((uint8_t *)dest) = (uint8_t)decoded;
+    return 0;
+}
+
+static int parse_size(void *dest, char *value) {
+    // `strtoull` would accept a sign and wrap negative values around.
+    if (!isdigit((unsigned char)value[0])) {
+        LOG_ERR("Invalid size '%s'.", value);
+        return 1;
+    }
+
+    char *end;
+    errno                   = 0;
+    unsigned long long size = strtoull(value, &end, 10);
+    if (errno == ERANGE || size > SIZE_MAX) {
+        LOG_ERR("Size '%s' is too large.", value);
+        return 1;
+    }
+
+    size_t multiplier = 1;
+    switch (*end) {
+    case 'G':
+        multiplier *= 1024;
+        // fallthrough
+    case 'M':
+        multiplier *= 1024;
+        // fallthrough
+    case 'K':
+        multiplier *= 1024;
+        end++;
+        break;
+    }
+
+    if (size > SIZE_MAX / multiplier) {
+        LOG_ERR("Size '%s' is too large.", value);
+        return 1;
+    }
+    size *= multiplier;
+
+    if (*end != '\0') {
+        LOG_ERR(
+            "Invalid size '%s'. Should be a number of bytes optionally "
+            "followed by 'K', 'M' or 'G'.",
+            value
+        );
+        return 1;
+    }
+
+    *((size_t *)dest) = size;
+    return 0;
+}
+
+static int parse_speculative_frames(void *dest, char *value) {
+    int decoded = atoi(value);
+    if (decoded < 0 || decoded > SURFACE_BUFFER_POOL_MAX_SIZE) {
+        LOG_ERR(
+            "Value should be between 0 and %d (included).",
+            SURFACE_BUFFER_POOL_MAX_SIZE
+        );
+        return 1;
+    }
+
+    *((uint8_t *)dest) = (uint8_t)decoded;
+    return 0;
+}
+
+static int parse_render_scale(void *dest, char *value) {
+    if (strcmp(value, "auto") == 0) {
+        *((double *)dest) = 0;
+        return 0;
+    }
+
+    char  *end;
+    double scale = strtod(value, &end);
+    if (end == value || *end != '\0' || !(scale > 0 && scale <= 1)) {
+        LOG_ERR(
+            "Invalid render scale '%s'. Should be 'auto' or a number in "
+            "(0, 1].",
+            value
+        );
+        return 1;
+    }
+
+    *((double *)dest) = scale;
+    return 0;
+}
+
 static int parse_relative_font_size(void *dest, char *value) {
     struct relative_font_size *rfs = dest;
 
@@ -289,6 +388,47 @@ static int parse_floating_mode_source_value(void *dest, char *value) {
     return 0;
 }
 
+static int parse_render_backend(void *dest, char *value) {
+    enum render_backend *out = dest;
+    if (strcmp(value, "cairo") == 0) {
+        *out = RENDER_BACKEND_CAIRO;
+    } else if (strcmp(value, "pixman") == 0) {
+#if PIXMAN_ENABLED
+        *out = RENDER_BACKEND_PIXMAN;
+#else
+        LOG_ERR("Binary not built with pixman. 'pixman' backend not supported.");
+        return 2;
+#endif
+    } else {
+        LOG_ERR(
+            "Invalid render backend '%s'. Should be 'cairo' or 'pixman'.", value
+        );
+        return 1;
+    }
+
+    return 0;
+}
+
+static int parse_label_order(void *dest, char *value) {
+    enum label_order *out = dest;
+    if (strcmp(value, "column") == 0) {
+        *out = LABEL_ORDER_COLUMN;
+    } else if (strcmp(value, "hilbert") == 0) {
+        *out = LABEL_ORDER_HILBERT;
+    } else if (strcmp(value, "z-order") == 0) {
+        *out = LABEL_ORDER_Z;
+    } else {
+        LOG_ERR(
+            "Invalid label order '%s'. Should be 'column', 'hilbert' or "
+            "'z-order'.",
+            value
+        );
+        return 1;
+    }
+
+    return 0;
+}
+
 static int parse_click(void *dest, char *value) {
     enum click *out = dest;
     if (strcmp(value, "none") == 0) {
@@ -376,7 +516,13 @@ static struct section_def section_defs[] = {
         G_FIELD(home_row_keys, "", parse_home_row_keys, free_home_row_keys),
         G_FIELD(modes, "tile,bisect", parse_str, free_str),
         G_FIELD(cancellation_status_code, "0", parse_uint8, noop),
-        G_FIELD(all_outputs, "false", parse_bool, noop)
+        G_FIELD(all_outputs, "false", parse_bool, noop),
+        G_FIELD(buffer_count, "2", parse_buffer_count, noop),
+        G_FIELD(prefault_shm, "false", parse_bool, noop),
+        G_FIELD(max_shm_bytes, "0", parse_size, noop),
+        G_FIELD(speculative_frames, "0", parse_speculative_frames, noop),
+        G_FIELD(render_backend, "cairo", parse_render_backend, noop),
+        G_FIELD(render_scale, "1", parse_render_scale, noop)
     ),
     SECTION(
         mode_tile, MT_FIELD(label_color, "#fffd", parse_color, noop),
@@ -388,7 +534,8 @@ static struct section_def section_defs[] = {
         MT_FIELD(label_font_size, "8 50% 100", parse_relative_font_size, noop),
         MT_FIELD(
             label_symbols, "abcdefghijklmnopqrstuvwxyz", parse_str, free_str
-        )
+        ),
+        MT_FIELD(label_order, "column", parse_label_order, noop)
     ),
     SECTION(
         mode_floating,
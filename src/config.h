@@ -6,11 +6,22 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+enum render_backend {
+    RENDER_BACKEND_CAIRO,
+    RENDER_BACKEND_PIXMAN,
+};
+
 struct general_config {
-    char  **home_row_keys;
-    char   *modes;
-    uint8_t cancellation_status_code;
-    bool    all_outputs;
+    char              **home_row_keys;
+    char               *modes;
+    uint8_t             cancellation_status_code;
+    bool                all_outputs;
+    uint8_t             buffer_count;
+    bool                prefault_shm;
+    size_t              max_shm_bytes; // 0 for no limit
+    uint8_t             speculative_frames;
+    enum render_backend render_backend;
+    double              render_scale; // 0 for auto
 };
 
 struct relative_font_size {
@@ -19,6 +30,13 @@ struct relative_font_size {
     double max;
 };
 
+// Order in which the cells of tile mode are labeled.
+enum label_order {
+    LABEL_ORDER_COLUMN,
+    LABEL_ORDER_HILBERT,
+    LABEL_ORDER_Z,
+};
+
 struct mode_tile_config {
     uint32_t                  label_color;
     uint32_t                  label_select_color;
@@ -28,6 +46,7 @@ struct mode_tile_config {
     char                     *label_font_family;
     struct relative_font_size label_font_size;
     char                     *label_symbols;
+    enum label_order          label_order;
 };
 
 enum floating_mode_source {
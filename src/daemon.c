@@ -0,0 +1,338 @@
+#include "daemon.h"
+
+#include "log.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Arbitrary limit on the size of a request's arguments.
+#define MAX_REQUEST_SIZE (64 * 1024)
+
+// Time a client has to send its request before it is dropped.
+#define REQUEST_TIMEOUT_S 2
+
+static const char *SOCKET_PATH_FMT = "%s/wl-kbptr-%s.sock";
+
+int daemon_socket_path(char *path, size_t len) {
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir == NULL) {
+        LOG_ERR("XDG_RUNTIME_DIR is not set.");
+        return 1;
+    }
+
+    const char *display = getenv("WAYLAND_DISPLAY");
+    if (display == NULL) {
+        display = "wayland-0";
+    }
+
+    // The display may be given as an absolute path to its socket.
+    const char *slash = strrchr(display, '/');
+    if (slash != NULL) {
+        display = slash + 1;
+    }
+
+    int n = snprintf(path, len, SOCKET_PATH_FMT, runtime_dir, display);
+    if (n < 0 || n >= len) {
+        LOG_ERR("Socket path is too long.");
+        return 2;
+    }
+
+    return 0;
+}
+
+static int fill_sockaddr(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        LOG_ERR("Socket path '%s' is too long.", path);
+        return 1;
+    }
+
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *c = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, c, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        c   += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len) {
+    char *c = buf;
+    while (len > 0) {
+        ssize_t n = read(fd, c, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        if (n == 0) {
+            return -1;
+        }
+
+        c   += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+int daemon_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (fill_sockaddr(&addr, path)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERR("Could not create socket.");
+        return -1;
+    }
+
+    // A stale socket may have been left behind by a daemon that didn't exit
+    // cleanly.
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        LOG_ERR("Could not bind socket to '%s'.", path);
+        close(fd);
+        return -1;
+    }
+
+    chmod(path, 0600);
+
+    if (listen(fd, 4) != 0) {
+        LOG_ERR("Could not listen on socket.");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int daemon_accept(int listen_fd, struct daemon_request *request) {
+    memset(request, 0, sizeof(*request));
+    request->input_fd = -1;
+
+    request->fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (request->fd < 0) {
+        LOG_ERR("Could not accept client connection.");
+        return 1;
+    }
+
+    // The requests are served one at a time so a silent client mustn't hold
+    // the others up.
+    struct timeval timeout = {.tv_sec = REQUEST_TIMEOUT_S};
+    setsockopt(
+        request->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)
+    );
+
+    // The header holds the size of the arguments that follow. The client's
+    // standard input is passed alongside it.
+    uint32_t size;
+    char     cmsg_buf[CMSG_SPACE(sizeof(int))];
+
+    struct iovec  iov = {.iov_base = &size, .iov_len = sizeof(size)};
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = cmsg_buf,
+        .msg_controllen = sizeof(cmsg_buf),
+    };
+
+    ssize_t n;
+    while ((n = recvmsg(request->fd, &msg, MSG_CMSG_CLOEXEC)) < 0 &&
+           errno == EINTR) {}
+    if (n != sizeof(size)) {
+        LOG_ERR("Invalid request header.");
+        goto err;
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg                 = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(&request->input_fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+
+    if (size == 0 || size > MAX_REQUEST_SIZE) {
+        LOG_ERR("Invalid request size (%u).", size);
+        goto err;
+    }
+
+    request->buf = malloc(size + 1);
+    if (read_all(request->fd, request->buf, size)) {
+        LOG_ERR("Could not read request.");
+        goto err;
+    }
+    request->buf[size] = '\0';
+
+    // The working directory and the arguments are `\0` separated.
+    char *end    = request->buf + size;
+    request->cwd = request->buf;
+    char *args   = request->cwd + strlen(request->cwd) + 1;
+
+    int argc = 1;
+    for (char *c = args; c < end; c += strlen(c) + 1) {
+        argc++;
+    }
+
+    request->argv    = malloc((argc + 1) * sizeof(char *));
+    request->argv[0] = "wl-kbptr";
+    request->argc    = 1;
+    for (char *c = args; c < end; c += strlen(c) + 1) {
+        request->argv[request->argc++] = c;
+    }
+    request->argv[request->argc] = NULL;
+
+    return 0;
+
+err:
+    daemon_request_free(request);
+    return 2;
+}
+
+void daemon_respond(
+    struct daemon_request *request, uint8_t status_code, const char *output
+) {
+    if (write_all(request->fd, &status_code, sizeof(status_code)) == 0 &&
+        output != NULL) {
+        write_all(request->fd, output, strlen(output));
+    }
+
+    close(request->fd);
+    request->fd = -1;
+}
+
+void daemon_request_free(struct daemon_request *request) {
+    if (request->fd >= 0) {
+        close(request->fd);
+    }
+
+    if (request->input_fd >= 0) {
+        close(request->input_fd);
+    }
+
+    free(request->argv);
+    free(request->buf);
+    memset(request, 0, sizeof(*request));
+    request->fd       = -1;
+    request->input_fd = -1;
+}
+
+int daemon_client_run(int argc, char **argv, int client_i) {
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    if (daemon_socket_path(path, sizeof(path))) {
+        return 1;
+    }
+
+    struct sockaddr_un addr;
+    if (fill_sockaddr(&addr, path)) {
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERR("Could not create socket.");
+        return 1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        LOG_ERR("Could not connect to daemon at '%s'.", path);
+        close(fd);
+        return 1;
+    }
+
+    // Relative paths in the arguments are resolved against it.
+    char *cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        LOG_WARN("Could not get the working directory.");
+    }
+
+    size_t size = (cwd != NULL ? strlen(cwd) : 0) + 1;
+    for (int i = 1; i < argc; i++) {
+        if (i != client_i) {
+            size += strlen(argv[i]) + 1;
+        }
+    }
+
+    char *payload = malloc(size);
+    char *c       = stpcpy(payload, cwd != NULL ? cwd : "") + 1;
+    for (int i = 1; i < argc; i++) {
+        if (i != client_i) {
+            c = stpcpy(c, argv[i]) + 1;
+        }
+    }
+    free(cwd);
+
+    uint32_t header = size;
+    char     cmsg_buf[CMSG_SPACE(sizeof(int))];
+    memset(cmsg_buf, 0, sizeof(cmsg_buf));
+
+    struct iovec  iov = {.iov_base = &header, .iov_len = sizeof(header)};
+    struct msghdr msg = {
+        .msg_iov        = &iov,
+        .msg_iovlen     = 1,
+        .msg_control    = cmsg_buf,
+        .msg_controllen = sizeof(cmsg_buf),
+    };
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level     = SOL_SOCKET;
+    cmsg->cmsg_type      = SCM_RIGHTS;
+    cmsg->cmsg_len       = CMSG_LEN(sizeof(int));
+    int input_fd         = STDIN_FILENO;
+    memcpy(CMSG_DATA(cmsg), &input_fd, sizeof(int));
+
+    int status_code = 1;
+
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(header) ||
+        write_all(fd, payload, size) != 0) {
+        LOG_ERR("Could not send request to daemon.");
+        goto end;
+    }
+
+    uint8_t status;
+    if (read_all(fd, &status, sizeof(status)) != 0) {
+        LOG_ERR("Daemon closed the connection.");
+        goto end;
+    }
+    status_code = status;
+
+    char    buf[256];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0 ||
+           (n < 0 && errno == EINTR)) {
+        if (n > 0) {
+            fwrite(buf, 1, n, stdout);
+        }
+    }
+
+end:
+    free(payload);
+    close(fd);
+    return status_code;
+}
@@ -0,0 +1,55 @@
+#ifndef __DAEMON_H_INCLUDED__
+#define __DAEMON_H_INCLUDED__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A selection request sent by a `--client` to a running `--daemon`. It carries
+ * the client's working directory, command line arguments and standard input.
+ */
+struct daemon_request {
+    int    fd;       // connection to the client
+    int    input_fd; // client's standard input or -1 if none was passed
+    char  *cwd;      // client's working directory, empty if unknown
+    int    argc;
+    char **argv; // `argv[0]` is a placeholder program name
+    char  *buf;  // backing storage for `argv` strings
+};
+
+/**
+ * `daemon_socket_path` writes the daemon's socket path in `path`, i.e.
+ * `$XDG_RUNTIME_DIR/wl-kbptr-$WAYLAND_DISPLAY.sock` with only the basename of
+ * `$WAYLAND_DISPLAY`. Returns 0 on success.
+ */
+int daemon_socket_path(char *path, size_t len);
+
+/**
+ * `daemon_listen` creates the listening socket at `path`. Returns the socket's
+ * file descriptor or a value < 0 upon error.
+ */
+int daemon_listen(const char *path);
+
+/**
+ * `daemon_accept` accepts the next client connection and reads its request.
+ * Returns 0 on success.
+ */
+int daemon_accept(int listen_fd, struct daemon_request *request);
+
+/**
+ * `daemon_respond` sends the status code and output back to the client and
+ * closes the connection.
+ */
+void daemon_respond(
+    struct daemon_request *request, uint8_t status_code, const char *output
+);
+
+void daemon_request_free(struct daemon_request *request);
+
+/**
+ * `daemon_client_run` forwards the given arguments, minus the `--client` at
+ * `client_i`, to the daemon, prints its output and returns its status code.
+ */
+int daemon_client_run(int argc, char **argv, int client_i);
+
+#endif
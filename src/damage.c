@@ -0,0 +1,87 @@
+#include "damage.h"
+
+#include <math.h>
+#include <stdint.h>
+
+void damage_clear(struct damage *damage) {
+    damage->full      = false;
+    damage->num_rects = 0;
+}
+
+void damage_set_full(struct damage *damage) {
+    damage->full      = true;
+    damage->num_rects = 0;
+}
+
+bool damage_is_empty(struct damage *damage) {
+    return !damage->full && damage->num_rects == 0;
+}
+
+static int64_t rect_area(struct rect r) {
+    return (int64_t)r.w * r.h;
+}
+
+void damage_add(struct damage *damage, struct rect rect) {
+    if (damage->full || rect.w <= 0 || rect.h <= 0) {
+        return;
+    }
+
+    if (damage->num_rects < DAMAGE_MAX_RECTS) {
+        damage->rects[damage->num_rects++] = rect;
+        return;
+    }
+
+    // Merge with the rect that grows the least.
+    int     best_i    = 0;
+    int64_t best_cost = INT64_MAX;
+    for (int i = 0; i < damage->num_rects; i++) {
+        int64_t cost = rect_area(rect_union(damage->rects[i], rect)) -
+                       rect_area(damage->rects[i]);
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_i    = i;
+        }
+    }
+
+    damage->rects[best_i] = rect_union(damage->rects[best_i], rect);
+}
+
+void damage_add_damage(struct damage *damage, struct damage *other) {
+    if (other->full) {
+        damage_set_full(damage);
+        return;
+    }
+
+    for (int i = 0; i < other->num_rects; i++) {
+        damage_add(damage, other->rects[i]);
+    }
+}
+
+struct rect damage_extents(struct damage *damage) {
+    if (damage->num_rects == 0) {
+        return (struct rect){0, 0, 0, 0};
+    }
+
+    struct rect extents = damage->rects[0];
+    for (int i = 1; i < damage->num_rects; i++) {
+        extents = rect_union(extents, damage->rects[i]);
+    }
+
+    return extents;
+}
+
+struct rect
+damage_label_rect(struct rect cell, int label_len, double font_size) {
+    // Glyphs are assumed to be at most one em wide and tall.
+    int text_w = ceil(label_len * font_size);
+    int text_h = ceil(font_size);
+
+    struct rect text = {
+        .x = cell.x + (cell.w - text_w) / 2 - 1,
+        .y = cell.y + (cell.h - text_h) / 2 - 1,
+        .w = text_w + 2,
+        .h = text_h + 2,
+    };
+
+    return rect_union(cell, text);
+}
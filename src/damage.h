@@ -0,0 +1,38 @@
+#ifndef __DAMAGE_H_INCLUDED__
+#define __DAMAGE_H_INCLUDED__
+
+#include "utils.h"
+
+#include <stdbool.h>
+
+#define DAMAGE_MAX_RECTS 64
+
+/**
+ * Set of areas that need to be redrawn, in the coordinates the modes render
+ * in. When there are more rects than `DAMAGE_MAX_RECTS`, rects are merged
+ * together so that the set only ever grows.
+ */
+struct damage {
+    bool        full;
+    int         num_rects;
+    struct rect rects[DAMAGE_MAX_RECTS];
+};
+
+void damage_clear(struct damage *damage);
+void damage_set_full(struct damage *damage);
+bool damage_is_empty(struct damage *damage);
+void damage_add(struct damage *damage, struct rect rect);
+void damage_add_damage(struct damage *damage, struct damage *other);
+
+// Bounding box of the damage's rects. Not meaningful for a full damage.
+struct rect damage_extents(struct damage *damage);
+
+/**
+ * `damage_label_rect` returns the area covered by a cell and its centered label
+ * of `label_len` symbols so that a label that overflows its cell is damaged
+ * entirely.
+ */
+struct rect
+damage_label_rect(struct rect cell, int label_len, double font_size);
+
+#endif
@@ -0,0 +1,286 @@
+#include "event_loop.h"
+
+#include "log.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// The Wayland connection, the signalfd and the timerfd come along the sources.
+#define EVENT_LOOP_MAX_EVENTS (EVENT_LOOP_MAX_SOURCES + 3)
+
+static void termination_signals(sigset_t *mask) {
+    sigemptyset(mask);
+    sigaddset(mask, SIGINT);
+    sigaddset(mask, SIGTERM);
+}
+
+static int epoll_add(int epoll_fd, int fd) {
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = fd};
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+int event_loop_init(struct event_loop *loop, struct wl_display *wl_display) {
+    loop->wl_display = wl_display;
+    loop->epoll_fd   = -1;
+    loop->signal_fd  = -1;
+    loop->timer_fd   = -1;
+    loop->terminated = false;
+    for (int i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+        loop->sources[i].fd = -1;
+    }
+
+    sigset_t mask;
+    termination_signals(&mask);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0) {
+        LOG_ERR("Could not block termination signals.");
+        return 1;
+    }
+
+    loop->epoll_fd  = epoll_create1(EPOLL_CLOEXEC);
+    loop->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    loop->timer_fd  = timerfd_create(
+        CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC
+    );
+    if (loop->epoll_fd < 0 || loop->signal_fd < 0 || loop->timer_fd < 0) {
+        LOG_ERR("Could not create event loop: %s.", strerror(errno));
+        event_loop_finish(loop);
+        return 1;
+    }
+
+    if (epoll_add(loop->epoll_fd, wl_display_get_fd(wl_display)) != 0 ||
+        epoll_add(loop->epoll_fd, loop->signal_fd) != 0 ||
+        epoll_add(loop->epoll_fd, loop->timer_fd) != 0) {
+        LOG_ERR("Could not set up event loop: %s.", strerror(errno));
+        event_loop_finish(loop);
+        return 1;
+    }
+
+    return 0;
+}
+
+void event_loop_finish(struct event_loop *loop) {
+    int fds[] = {loop->epoll_fd, loop->signal_fd, loop->timer_fd};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+
+    loop->epoll_fd  = -1;
+    loop->signal_fd = -1;
+    loop->timer_fd  = -1;
+
+    sigset_t mask;
+    termination_signals(&mask);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+}
+
+int event_loop_add_fd(
+    struct event_loop *loop, int fd, event_loop_fd_fn fn, void *data
+) {
+    for (int i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+        if (loop->sources[i].fd >= 0) {
+            continue;
+        }
+
+        if (epoll_add(loop->epoll_fd, fd) != 0) {
+            return 1;
+        }
+
+        loop->sources[i] = (struct event_loop_source){
+            .fd   = fd,
+            .fn   = fn,
+            .data = data,
+        };
+        return 0;
+    }
+
+    LOG_ERR("Too many event loop sources.");
+    return 1;
+}
+
+void event_loop_remove_fd(struct event_loop *loop, int fd) {
+    for (int i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+        if (loop->sources[i].fd == fd) {
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            loop->sources[i].fd = -1;
+            return;
+        }
+    }
+}
+
+void event_loop_set_timer(struct event_loop *loop, int timeout) {
+    // A zero `it_value` disarms the timer so fire right away instead.
+    struct itimerspec spec = {0};
+    if (timeout >= 0) {
+        spec.it_value.tv_sec  = timeout / 1000;
+        spec.it_value.tv_nsec = timeout % 1000 * 1000000 + (timeout == 0);
+    }
+
+    timerfd_settime(loop->timer_fd, 0, &spec, NULL);
+}
+
+static void handle_signals(struct event_loop *loop) {
+    struct signalfd_siginfo info;
+    while (read(loop->signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        LOG_INFO("Got %s, cancelling.", strsignal(info.ssi_signo));
+        loop->terminated = true;
+    }
+}
+
+static void handle_source(struct event_loop *loop, int fd, uint32_t events) {
+    // The source may have been removed by a previous event's handler.
+    for (int i = 0; i < EVENT_LOOP_MAX_SOURCES; i++) {
+        if (loop->sources[i].fd == fd) {
+            loop->sources[i].fn(loop->sources[i].data, fd, events);
+            return;
+        }
+    }
+}
+
+bool event_loop_wait_fd(struct event_loop *loop, int fd) {
+    int  wl_fd    = wl_display_get_fd(loop->wl_display);
+    bool watch_wl = true;
+    while (!loop->terminated) {
+        // The events can't be read while some are queued but the requests are
+        // still flushed.
+        bool reading =
+            watch_wl && wl_display_prepare_read(loop->wl_display) == 0;
+        wl_display_flush(loop->wl_display);
+
+        struct pollfd fds[] = {
+            {.fd = fd, .events = POLLIN},
+            {.fd = loop->signal_fd, .events = POLLIN},
+            {.fd = reading ? wl_fd : -1, .events = POLLIN},
+        };
+        if (poll(fds, sizeof(fds) / sizeof(fds[0]), -1) < 0) {
+            if (reading) {
+                wl_display_cancel_read(loop->wl_display);
+            }
+
+            // Let the caller's read fail rather than spin.
+            if (errno != EINTR) {
+                return true;
+            }
+            continue;
+        }
+
+        if (reading) {
+            if (fds[2].revents & POLLIN) {
+                watch_wl = wl_display_read_events(loop->wl_display) == 0;
+            } else {
+                wl_display_cancel_read(loop->wl_display);
+                watch_wl = !(fds[2].revents & (POLLERR | POLLHUP));
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            handle_signals(loop);
+        }
+
+        if (fds[0].revents != 0) {
+            return !loop->terminated;
+        }
+    }
+
+    return false;
+}
+
+int event_loop_dispatch_queue(
+    struct event_loop *loop, struct wl_event_queue *queue
+) {
+    struct wl_display *wl_display = loop->wl_display;
+    if (wl_display_prepare_read_queue(wl_display, queue) != 0) {
+        return wl_display_dispatch_queue_pending(wl_display, queue);
+    }
+    wl_display_flush(wl_display);
+
+    struct pollfd fds[] = {
+        {.fd = wl_display_get_fd(wl_display), .events = POLLIN},
+        {.fd = loop->signal_fd, .events = POLLIN},
+    };
+    if (poll(fds, sizeof(fds) / sizeof(fds[0]), -1) < 0) {
+        wl_display_cancel_read(wl_display);
+        return errno == EINTR ? 0 : -1;
+    }
+
+    if (fds[0].revents & POLLIN) {
+        if (wl_display_read_events(wl_display) < 0) {
+            return -1;
+        }
+    } else {
+        wl_display_cancel_read(wl_display);
+        if (fds[0].revents & (POLLERR | POLLHUP)) {
+            return -1;
+        }
+    }
+
+    if (fds[1].revents & POLLIN) {
+        handle_signals(loop);
+    }
+
+    return wl_display_dispatch_queue_pending(wl_display, queue);
+}
+
+int event_loop_dispatch(struct event_loop *loop, int timeout) {
+    if (wl_display_prepare_read(loop->wl_display) != 0) {
+        return wl_display_dispatch_pending(loop->wl_display);
+    }
+    wl_display_flush(loop->wl_display);
+
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+    int num_events = epoll_wait(
+        loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, timeout
+    );
+    if (num_events <= 0) {
+        wl_display_cancel_read(loop->wl_display);
+        return num_events < 0 && errno != EINTR ? -1 : 0;
+    }
+
+    // The Wayland events are read first as nothing may dispatch them while the
+    // read is prepared.
+    int      wl_fd     = wl_display_get_fd(loop->wl_display);
+    uint32_t wl_events = 0;
+    for (int i = 0; i < num_events; i++) {
+        if (events[i].data.fd == wl_fd) {
+            wl_events = events[i].events;
+        }
+    }
+
+    if (wl_events & EPOLLIN) {
+        if (wl_display_read_events(loop->wl_display) < 0) {
+            return -1;
+        }
+    } else {
+        wl_display_cancel_read(loop->wl_display);
+        if (wl_events & (EPOLLERR | EPOLLHUP)) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < num_events; i++) {
+        int fd = events[i].data.fd;
+        if (fd == wl_fd) {
+            continue;
+        } else if (fd == loop->signal_fd) {
+            handle_signals(loop);
+        } else if (fd == loop->timer_fd) {
+            uint64_t expirations;
+            read(loop->timer_fd, &expirations, sizeof(expirations));
+        } else {
+            handle_source(loop, fd, events[i].events);
+        }
+    }
+
+    if (wl_display_dispatch_pending(loop->wl_display) < 0) {
+        return -1;
+    }
+
+    return num_events;
+}
@@ -0,0 +1,81 @@
+#ifndef __EVENT_LOOP_H_INCLUDED__
+#define __EVENT_LOOP_H_INCLUDED__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <wayland-client.h>
+
+#define EVENT_LOOP_MAX_SOURCES 4
+
+typedef void (*event_loop_fd_fn)(void *data, int fd, uint32_t events);
+
+struct event_loop_source {
+    int              fd; // -1 when the slot is free
+    event_loop_fd_fn fn;
+    void            *data;
+};
+
+/**
+ * Waits on the Wayland connection, a timer, `SIGINT`/`SIGTERM` and other file
+ * descriptors at once with epoll. The signals are blocked and received through
+ * a signalfd so that they can't interrupt a frame half way.
+ */
+struct event_loop {
+    struct wl_display *wl_display;
+    int                epoll_fd;
+    int                signal_fd;
+    int                timer_fd;
+    bool               terminated; // `SIGINT` or `SIGTERM` was received
+
+    struct event_loop_source sources[EVENT_LOOP_MAX_SOURCES];
+};
+
+/**
+ * `event_loop_init` must be called before any thread is started so that they
+ * all inherit the blocked signals. Returns non-zero upon error.
+ */
+int  event_loop_init(struct event_loop *loop, struct wl_display *wl_display);
+void event_loop_finish(struct event_loop *loop);
+
+/**
+ * `event_loop_add_fd` calls `fn` whenever `fd` is readable or hung up until it
+ * is removed. Returns non-zero upon error, e.g. for regular files which can't
+ * be watched.
+ */
+int event_loop_add_fd(
+    struct event_loop *loop, int fd, event_loop_fd_fn fn, void *data
+);
+void event_loop_remove_fd(struct event_loop *loop, int fd);
+
+/**
+ * `event_loop_set_timer` wakes the loop up in `timeout` ms, replacing the
+ * previous timer. A negative `timeout` disarms it.
+ */
+void event_loop_set_timer(struct event_loop *loop, int timeout);
+
+/**
+ * `event_loop_wait_fd` waits for `fd` to be readable. Meanwhile the Wayland
+ * requests are flushed and the events are read but left queued, as this may
+ * be called from a Wayland event handler. Returns false if a termination
+ * signal came first.
+ */
+bool event_loop_wait_fd(struct event_loop *loop, int fd);
+
+/**
+ * `event_loop_dispatch_queue` waits for events of `queue` and dispatches them.
+ * The other Wayland events are read but left queued, as with
+ * `event_loop_wait_fd`. Returns the number of events dispatched, 0 when a
+ * signal came first or < 0 when the Wayland connection is lost.
+ */
+int event_loop_dispatch_queue(
+    struct event_loop *loop, struct wl_event_queue *queue
+);
+
+/**
+ * `event_loop_dispatch` waits at most `timeout` ms, or indefinitely if it's -1,
+ * and handles the events that came in. Returns the number of events handled,
+ * 0 on timeout or < 0 when the Wayland connection is lost.
+ */
+int event_loop_dispatch(struct event_loop *loop, int timeout);
+
+#endif
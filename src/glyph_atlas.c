@@ -0,0 +1,229 @@
+#include "glyph_atlas.h"
+
+#include "log.h"
+#include "utils_cairo.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Margin around each glyph so that anti-aliased edges are not cut.
+#define GLYPH_MARGIN 1
+
+static struct glyph_atlas *glyph_atlas_new(
+    cairo_font_face_t *font_face, label_symbols_t *label_symbols,
+    int device_font_size
+) {
+    int                 num_glyphs = label_symbols->num_symbols;
+    struct glyph_atlas *atlas =
+        calloc(1, sizeof(*atlas) + num_glyphs * sizeof(struct glyph));
+    atlas->refs             = 1;
+    atlas->device_font_size = device_font_size;
+    atlas->num_glyphs       = num_glyphs;
+
+    // Measure the glyphs first to size the atlas.
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
+    cairo_t         *cairo   = cairo_create(surface);
+    cairo_set_font_face(cairo, font_face);
+    cairo_set_font_size(cairo, device_font_size);
+
+    int offsets[num_glyphs];
+    int widths[num_glyphs];
+    int heights[num_glyphs];
+    int atlas_width  = 0;
+    int atlas_height = 1;
+
+    for (int i = 0; i < num_glyphs; i++) {
+        struct glyph        *glyph = &atlas->glyphs[i];
+        cairo_text_extents_t te;
+        cairo_text_extents(
+            cairo, label_symbols_idx_to_ptr(label_symbols, i), &te
+        );
+
+        glyph->y_bearing = te.y_bearing;
+        glyph->height    = te.height;
+        glyph->x_advance = te.x_advance;
+
+        glyph->mask_x = floor(te.x_bearing) - GLYPH_MARGIN;
+        glyph->mask_y = floor(te.y_bearing) - GLYPH_MARGIN;
+        widths[i] = ceil(te.x_bearing + te.width) + GLYPH_MARGIN - glyph->mask_x;
+        heights[i] =
+            ceil(te.y_bearing + te.height) + GLYPH_MARGIN - glyph->mask_y;
+
+        offsets[i]    = atlas_width;
+        atlas_width  += widths[i];
+        atlas_height  = max(atlas_height, heights[i]);
+    }
+
+    cairo_destroy(cairo);
+    cairo_surface_destroy(surface);
+
+    atlas->surface = cairo_image_surface_create(
+        CAIRO_FORMAT_A8, max(atlas_width, 1), atlas_height
+    );
+    cairo = cairo_create(atlas->surface);
+    cairo_set_font_face(cairo, font_face);
+    cairo_set_font_size(cairo, device_font_size);
+
+    for (int i = 0; i < num_glyphs; i++) {
+        struct glyph *glyph = &atlas->glyphs[i];
+        cairo_move_to(cairo, offsets[i] - glyph->mask_x, -glyph->mask_y);
+        cairo_show_text(cairo, label_symbols_idx_to_ptr(label_symbols, i));
+    }
+
+    cairo_destroy(cairo);
+    cairo_surface_flush(atlas->surface);
+
+    for (int i = 0; i < num_glyphs; i++) {
+        atlas->glyphs[i].mask_rect = (struct rect){
+            .x = offsets[i],
+            .y = 0,
+            .w = widths[i],
+            .h = heights[i],
+        };
+        atlas->glyphs[i].mask = cairo_surface_create_for_rectangle(
+            atlas->surface, offsets[i], 0, widths[i], heights[i]
+        );
+    }
+
+    return atlas;
+}
+
+static void glyph_atlas_unref(struct glyph_atlas *atlas) {
+    if (--atlas->refs > 0) {
+        return;
+    }
+
+    for (int i = 0; i < atlas->num_glyphs; i++) {
+        cairo_surface_destroy(atlas->glyphs[i].mask);
+    }
+
+    cairo_surface_destroy(atlas->surface);
+    free(atlas);
+}
+
+void glyph_atlas_cache_init(
+    struct glyph_atlas_cache *cache, cairo_font_face_t *font_face,
+    label_symbols_t *label_symbols
+) {
+    memset(cache, 0, sizeof(*cache));
+    pthread_mutex_init(&cache->mutex, NULL);
+    cache->font_face     = font_face;
+    cache->label_symbols = label_symbols;
+}
+
+void glyph_atlas_cache_free(struct glyph_atlas_cache *cache) {
+    for (int i = 0; i < GLYPH_ATLAS_CACHE_SIZE; i++) {
+        if (cache->atlases[i] != NULL) {
+            glyph_atlas_unref(cache->atlases[i]);
+        }
+    }
+
+    pthread_mutex_destroy(&cache->mutex);
+    memset(cache, 0, sizeof(*cache));
+}
+
+struct glyph_atlas *glyph_atlas_cache_get(
+    struct glyph_atlas_cache *cache, cairo_t *cairo, double font_size
+) {
+    cairo_matrix_t matrix;
+    cairo_get_matrix(cairo, &matrix);
+    int device_font_size = max(round(font_size * matrix.xx), 1);
+
+    pthread_mutex_lock(&cache->mutex);
+    for (int i = 0; i < GLYPH_ATLAS_CACHE_SIZE; i++) {
+        struct glyph_atlas *atlas = cache->atlases[i];
+        if (atlas != NULL && atlas->device_font_size == device_font_size) {
+            atlas->refs++;
+            pthread_mutex_unlock(&cache->mutex);
+            return atlas;
+        }
+    }
+
+    LOG_DEBUG("Building glyph atlas for %dpx font size.", device_font_size);
+
+    struct glyph_atlas **slot = &cache->atlases[cache->next];
+    cache->next               = (cache->next + 1) % GLYPH_ATLAS_CACHE_SIZE;
+
+    if (*slot != NULL) {
+        glyph_atlas_unref(*slot);
+    }
+
+    *slot = glyph_atlas_new(
+        cache->font_face, cache->label_symbols, device_font_size
+    );
+    struct glyph_atlas *atlas = *slot;
+    atlas->refs++;
+    pthread_mutex_unlock(&cache->mutex);
+
+    return atlas;
+}
+
+void glyph_atlas_release(
+    struct glyph_atlas_cache *cache, struct glyph_atlas *atlas
+) {
+    pthread_mutex_lock(&cache->mutex);
+    glyph_atlas_unref(atlas);
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void glyph_atlas_label_origin(
+    struct glyph_atlas *atlas, cairo_t *cairo, label_selection_t *label,
+    struct rect rect, double *x, int *y
+) {
+    cairo_matrix_t matrix;
+    cairo_get_matrix(cairo, &matrix);
+    double scale = matrix.xx;
+
+    // Ink extents of the label, ignoring blank glyphs like `cairo_text_extents`
+    // does.
+    double x_advance = 0;
+    double top       = INFINITY;
+    double bottom    = -INFINITY;
+    for (int i = 0; i < label->next; i++) {
+        struct glyph *glyph  = &atlas->glyphs[label->input[i]];
+        x_advance           += glyph->x_advance;
+
+        if (glyph->height > 0) {
+            top    = fmin(top, glyph->y_bearing);
+            bottom = fmax(bottom, glyph->y_bearing + glyph->height);
+        }
+    }
+    double height = top < bottom ? bottom - top : 0;
+
+    // Same placement as the label's text centered in `rect`.
+    double pen_x = rect.x + (rect.w - x_advance / scale) / 2;
+    double pen_y = rect.y + (int)((rect.h + height / scale) / 2);
+    cairo_user_to_device(cairo, &pen_x, &pen_y);
+
+    *x = pen_x;
+    *y = round(pen_y);
+}
+
+void glyph_atlas_draw_label(
+    struct glyph_atlas *atlas, cairo_t *cairo, label_selection_t *label,
+    int cut, struct rect rect, uint32_t selected_color, uint32_t color
+) {
+    double x;
+    int    pen_y;
+    glyph_atlas_label_origin(atlas, cairo, label, rect, &x, &pen_y);
+
+    // Glyphs are blitted on whole device pixels.
+    cairo_save(cairo);
+    cairo_identity_matrix(cairo);
+
+    cairo_set_source_u32(cairo, selected_color);
+    for (int i = 0; i < label->next; i++) {
+        if (i == cut) {
+            cairo_set_source_u32(cairo, color);
+        }
+
+        struct glyph *glyph = &atlas->glyphs[label->input[i]];
+        cairo_mask_surface(
+            cairo, glyph->mask, round(x) + glyph->mask_x, pen_y + glyph->mask_y
+        );
+        x += glyph->x_advance;
+    }
+
+    cairo_restore(cairo);
+}
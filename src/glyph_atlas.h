@@ -0,0 +1,91 @@
+#ifndef __GLYPH_ATLAS_H_INCLUDED__
+#define __GLYPH_ATLAS_H_INCLUDED__
+
+#include "label.h"
+#include "utils.h"
+
+#include <cairo.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#define GLYPH_ATLAS_CACHE_SIZE 16
+
+/**
+ * A label symbol rasterized in a glyph atlas. Metrics are in device pixels.
+ */
+struct glyph {
+    cairo_surface_t *mask;      // the glyph's area of the atlas
+    struct rect      mask_rect; // position of `mask` in the atlas
+
+    // Position of the mask relative to the pen position.
+    int mask_x;
+    int mask_y;
+
+    double y_bearing;
+    double height;
+    double x_advance;
+};
+
+/**
+ * The symbols of a label alphabet rasterized once as an alpha mask for a given
+ * font size in device pixels. Labels are drawn by masking the current source
+ * with the glyphs so a single atlas serves every color.
+ */
+struct glyph_atlas {
+    int              refs; // the cache's and the renders' using it
+    int              device_font_size;
+    cairo_surface_t *surface;
+    int              num_glyphs;
+    struct glyph     glyphs[];
+};
+
+/**
+ * Atlases are shared by the overlays rendered concurrently so the cache is
+ * locked and an evicted atlas lives until its last render releases it.
+ */
+struct glyph_atlas_cache {
+    pthread_mutex_t     mutex;
+    cairo_font_face_t  *font_face;
+    label_symbols_t    *label_symbols;
+    struct glyph_atlas *atlases[GLYPH_ATLAS_CACHE_SIZE];
+    int                 next; // slot to evict next
+};
+
+void glyph_atlas_cache_init(
+    struct glyph_atlas_cache *cache, cairo_font_face_t *font_face,
+    label_symbols_t *label_symbols
+);
+void glyph_atlas_cache_free(struct glyph_atlas_cache *cache);
+
+/**
+ * `glyph_atlas_cache_get` returns the atlas for the font size in user space
+ * units, scaled by the `cairo` context's transformation. Sizes are rounded to
+ * whole device pixels. It must be released with `glyph_atlas_release`.
+ */
+struct glyph_atlas *glyph_atlas_cache_get(
+    struct glyph_atlas_cache *cache, cairo_t *cairo, double font_size
+);
+void glyph_atlas_release(
+    struct glyph_atlas_cache *cache, struct glyph_atlas *atlas
+);
+
+/**
+ * `glyph_atlas_label_origin` sets `x` and `y` to the pen position, in device
+ * pixels, at which `label` is centered in `rect`.
+ */
+void glyph_atlas_label_origin(
+    struct glyph_atlas *atlas, cairo_t *cairo, label_selection_t *label,
+    struct rect rect, double *x, int *y
+);
+
+/**
+ * `glyph_atlas_draw_label` draws `label` centered in `rect` with its first
+ * `cut` symbols in `selected_color` and the others in `color`, using the
+ * context's current operator.
+ */
+void glyph_atlas_draw_label(
+    struct glyph_atlas *atlas, cairo_t *cairo, label_selection_t *label,
+    int cut, struct rect rect, uint32_t selected_color, uint32_t color
+);
+
+#endif
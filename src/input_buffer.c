@@ -0,0 +1,60 @@
+#include "input_buffer.h"
+
+#include "log.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define INPUT_BUFFER_MIN_READ 4096
+
+void input_buffer_init(struct input_buffer *buf) {
+    buf->data = NULL;
+    buf->len  = 0;
+    buf->cap  = 0;
+    buf->done = false;
+}
+
+void input_buffer_finish(struct input_buffer *buf) {
+    free(buf->data);
+    input_buffer_init(buf);
+}
+
+bool input_buffer_read(struct input_buffer *buf, int fd) {
+    if (buf->done) {
+        return true;
+    }
+
+    // Room for the NUL terminator is kept.
+    if (buf->cap - buf->len < INPUT_BUFFER_MIN_READ + 1) {
+        size_t cap  = buf->cap * 2 + INPUT_BUFFER_MIN_READ + 1;
+        char  *data = realloc(buf->data, cap);
+        if (data == NULL) {
+            LOG_ERR("Could not allocate input buffer.");
+            buf->done = true;
+            return true;
+        }
+
+        buf->data = data;
+        buf->cap  = cap;
+    }
+
+    ssize_t n = read(fd, buf->data + buf->len, buf->cap - buf->len - 1);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return false;
+    }
+
+    if (n < 0) {
+        LOG_ERR("Could not read input: %s.", strerror(errno));
+    }
+
+    if (n > 0) {
+        buf->len += n;
+    } else {
+        buf->done = true;
+    }
+
+    buf->data[buf->len] = '\0';
+    return buf->done;
+}
@@ -0,0 +1,27 @@
+#ifndef __INPUT_BUFFER_H_INCLUDED__
+#define __INPUT_BUFFER_H_INCLUDED__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Everything read from an input file descriptor, gathered while the overlay
+ * is set up rather than when the mode needing it is entered.
+ */
+struct input_buffer {
+    char  *data; // NUL terminated
+    size_t len;
+    size_t cap;
+    bool   done; // end of file or error reached
+};
+
+void input_buffer_init(struct input_buffer *buf);
+void input_buffer_finish(struct input_buffer *buf);
+
+/**
+ * `input_buffer_read` appends what a single read of `fd` returns. Returns true
+ * once there is nothing left to read.
+ */
+bool input_buffer_read(struct input_buffer *buf, int fd);
+
+#endif
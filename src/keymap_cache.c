@@ -0,0 +1,151 @@
+#include "keymap_cache.h"
+
+#include "log.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bumped whenever `struct keymap_cache` changes.
+#define KEYMAP_CACHE_MAGIC 0x6b62706b6d617003ull
+
+static const char *CACHE_DIR_FMT  = "%s/wl-kbptr";
+static const char *CACHE_FILE_FMT = "%s/wl-kbptr/keymap";
+
+void keymap_cache_fill(struct keymap_cache *cache, struct xkb_keymap *keymap) {
+    struct xkb_state *xkb_state = xkb_state_new(keymap);
+    for (int i = 0; i < KEYMAP_CACHE_NUM_KEYCODES; i++) {
+        cache->keysyms[i]     = xkb_state_key_get_one_sym(xkb_state, i);
+        cache->locked_mods[i] = 0;
+    }
+    xkb_state_unref(xkb_state);
+
+    // Each modifier is locked on its own, their combinations aren't checked.
+    xkb_mod_index_t num_mods = xkb_keymap_num_mods(keymap);
+    for (xkb_mod_index_t m = 0; m < num_mods && m < 32; m++) {
+        xkb_state = xkb_state_new(keymap);
+        xkb_state_update_mask(xkb_state, 0, 0, 1u << m, 0, 0, 0);
+        for (int i = 0; i < KEYMAP_CACHE_NUM_KEYCODES; i++) {
+            if (xkb_state_key_get_one_sym(xkb_state, i) != cache->keysyms[i]) {
+                cache->locked_mods[i] |= 1u << m;
+            }
+        }
+        xkb_state_unref(xkb_state);
+    }
+}
+
+// `cache_home` sets `path` to `$XDG_CACHE_HOME` or its default. Returns false
+// if neither is set.
+static bool cache_home(char *path, size_t len) {
+    const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+    const char *home           = getenv("HOME");
+
+    int ret;
+    if (xdg_cache_home != NULL && xdg_cache_home[0] != '\0') {
+        ret = snprintf(path, len, "%s", xdg_cache_home);
+    } else if (home != NULL) {
+        ret = snprintf(path, len, "%s/.cache", home);
+    } else {
+        return false;
+    }
+
+    return ret > 0 && ret < len;
+}
+
+// `make_dirs` creates the directory `path` and its missing parents.
+static bool make_dirs(char *path) {
+    for (char *c = path + 1; *c != '\0'; c++) {
+        if (*c == '/') {
+            *c = '\0';
+            mkdir(path, 0700);
+            *c = '/';
+        }
+    }
+
+    return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
+// `is_valid` checks that the home row of a cache read from disk stays within
+// its buffer.
+static bool is_valid(struct keymap_cache *cache) {
+    if (cache->home_row_valid > 1) {
+        return false;
+    }
+
+    for (int i = 0; i < KEYMAP_CACHE_HOME_ROW_LEN; i++) {
+        size_t offset = cache->home_row_offsets[i];
+        if (offset >= KEYMAP_CACHE_HOME_ROW_BUF ||
+            memchr(
+                cache->home_row_buffer + offset, '\0',
+                KEYMAP_CACHE_HOME_ROW_BUF - offset
+            ) == NULL) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool keymap_cache_load(struct keymap_cache *cache, uint64_t hash, size_t size) {
+    char home[PATH_MAX];
+    char path[PATH_MAX];
+    if (!cache_home(home, sizeof(home))) {
+        return false;
+    }
+    snprintf(path, sizeof(path), CACHE_FILE_FMT, home);
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+
+    uint64_t magic;
+    bool     loaded = fread(&magic, sizeof(magic), 1, f) == 1 &&
+                  magic == KEYMAP_CACHE_MAGIC &&
+                  fread(cache, sizeof(*cache), 1, f) == 1;
+    fclose(f);
+
+    if (loaded && !is_valid(cache)) {
+        LOG_WARN("Ignoring corrupted keymap cache '%s'.", path);
+        return false;
+    }
+
+    return loaded && cache->hash == hash && cache->size == size;
+}
+
+void keymap_cache_save(struct keymap_cache *cache) {
+    char home[PATH_MAX];
+    char dir[PATH_MAX];
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX + 8];
+    if (!cache_home(home, sizeof(home))) {
+        return;
+    }
+    snprintf(dir, sizeof(dir), CACHE_DIR_FMT, home);
+    snprintf(path, sizeof(path), CACHE_FILE_FMT, home);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, getpid());
+
+    if (!make_dirs(dir)) {
+        LOG_WARN("Could not create cache directory '%s'.", dir);
+        return;
+    }
+
+    // Written aside then renamed so that concurrent runs never read a
+    // partial cache.
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        LOG_WARN("Could not write keymap cache '%s'.", tmp_path);
+        return;
+    }
+
+    uint64_t magic = KEYMAP_CACHE_MAGIC;
+    bool     written = fwrite(&magic, sizeof(magic), 1, f) == 1 &&
+                   fwrite(cache, sizeof(*cache), 1, f) == 1;
+    if (fclose(f) != 0 || !written || rename(tmp_path, path) != 0) {
+        LOG_WARN("Could not write keymap cache '%s'.", path);
+        unlink(tmp_path);
+    }
+}
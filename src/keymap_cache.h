@@ -0,0 +1,48 @@
+#ifndef __KEYMAP_CACHE_H_INCLUDED__
+#define __KEYMAP_CACHE_H_INCLUDED__
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <xkbcommon/xkbcommon.h>
+
+#define KEYMAP_CACHE_NUM_KEYCODES 256
+#define KEYMAP_CACHE_HOME_ROW_LEN 11
+#define KEYMAP_CACHE_HOME_ROW_BUF 128
+
+/**
+ * What wl-kbptr resolves from a keymap, saved across invocations so that an
+ * unchanged keymap doesn't need to be compiled before the first key press
+ * with a modifier.
+ */
+struct keymap_cache {
+    uint64_t hash; // of the keymap's text
+    uint64_t size; // of the keymap's text
+
+    uint8_t home_row_valid; // not a `bool` as it is read from disk
+    char    home_row_buffer[KEYMAP_CACHE_HOME_ROW_BUF];
+    uint8_t home_row_offsets[KEYMAP_CACHE_HOME_ROW_LEN];
+
+    // Keysym of each keycode without any modifier or group.
+    xkb_keysym_t keysyms[KEYMAP_CACHE_NUM_KEYCODES];
+
+    // Locked modifiers that change the keysym of each keycode, e.g. Num Lock
+    // only changes the keypad's.
+    uint32_t locked_mods[KEYMAP_CACHE_NUM_KEYCODES];
+};
+
+// `keymap_cache_fill` sets the keysyms and locked modifiers of `cache` from
+// `keymap`.
+void keymap_cache_fill(struct keymap_cache *cache, struct xkb_keymap *keymap);
+
+/**
+ * `keymap_cache_load` loads the cache saved for the keymap of `hash` and
+ * `size`. Returns false if there is none or it is corrupted.
+ */
+bool keymap_cache_load(struct keymap_cache *cache, uint64_t hash, size_t size);
+
+// `keymap_cache_save` saves the cache in `$XDG_CACHE_HOME/wl-kbptr/`.
+void keymap_cache_save(struct keymap_cache *cache);
+
+#endif
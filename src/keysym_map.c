@@ -0,0 +1,114 @@
+#include "keysym_map.h"
+
+#include "utils.h"
+
+#include <stdint.h>
+#include <string.h>
+
+static int keysym_map_slot(struct keysym_map *map, xkb_keysym_t keysym) {
+    // Fibonacci hashing to spread the mostly consecutive keysyms.
+    int slot = (uint32_t)(keysym * 2654435769u) >> 22;
+    while (map->keysyms[slot] != XKB_KEY_NoSymbol &&
+           map->keysyms[slot] != keysym) {
+        slot = (slot + 1) % KEYSYM_MAP_SIZE;
+    }
+
+    return slot;
+}
+
+void keysym_map_clear(struct keysym_map *map) {
+    map->num_entries = 0;
+    for (int i = 0; i < KEYSYM_MAP_SIZE; i++) {
+        map->keysyms[i] = XKB_KEY_NoSymbol;
+    }
+}
+
+int keysym_map_get(struct keysym_map *map, xkb_keysym_t keysym) {
+    if (keysym == XKB_KEY_NoSymbol) {
+        return KEYSYM_MAP_MISSING;
+    }
+
+    int slot = keysym_map_slot(map, keysym);
+    return map->keysyms[slot] == keysym ? map->indices[slot]
+                                        : KEYSYM_MAP_MISSING;
+}
+
+void keysym_map_set(struct keysym_map *map, xkb_keysym_t keysym, int idx) {
+    if (keysym == XKB_KEY_NoSymbol) {
+        return;
+    }
+
+    int slot = keysym_map_slot(map, keysym);
+    if (map->keysyms[slot] == XKB_KEY_NoSymbol) {
+        if (map->num_entries >= KEYSYM_MAP_SIZE / 2) {
+            return;
+        }
+
+        map->keysyms[slot] = keysym;
+        map->num_entries++;
+    }
+    map->indices[slot] = idx;
+}
+
+void keysym_map_set_str(struct keysym_map *map, char *s, int idx) {
+    uint32_t rune;
+    int      len = str_to_rune(s, &rune);
+    if (len <= 0 || s[len] != '\0') {
+        return;
+    }
+
+    // The keysym must type `s` back. Only set it if no earlier symbol is
+    // typed with the same keysym, as the first match wins when comparing
+    // texts.
+    xkb_keysym_t keysym = xkb_utf32_to_keysym(rune);
+    char         text[8];
+    if (xkb_keysym_to_utf8(keysym, text, sizeof(text)) <= 0 ||
+        strcmp(text, s) != 0 ||
+        keysym_map_get(map, keysym) != KEYSYM_MAP_MISSING) {
+        return;
+    }
+
+    keysym_map_set(map, keysym, idx);
+}
+
+void keysym_map_init_label_symbols(
+    struct keysym_map *map, label_symbols_t *label_symbols
+) {
+    keysym_map_clear(map);
+    for (int i = 0; i < label_symbols->num_symbols; i++) {
+        keysym_map_set_str(map, label_symbols_idx_to_ptr(label_symbols, i), i);
+    }
+}
+
+int keysym_map_find_label_symbol(
+    struct keysym_map *map, label_symbols_t *label_symbols,
+    xkb_keysym_t keysym, char *text
+) {
+    int idx = keysym_map_get(map, keysym);
+    if (idx == KEYSYM_MAP_MISSING) {
+        idx = label_symbols_find_idx(label_symbols, text);
+        keysym_map_set(map, keysym, idx);
+    }
+
+    return idx;
+}
+
+void keysym_map_init_strs(struct keysym_map *map, char **strs, int num_strs) {
+    keysym_map_clear(map);
+    for (int i = 0; i < num_strs; i++) {
+        keysym_map_set_str(map, strs[i], i);
+    }
+}
+
+int keysym_map_find_str(
+    struct keysym_map *map, char **strs, int num_strs, xkb_keysym_t keysym,
+    char *text
+) {
+    int idx = keysym_map_get(map, keysym);
+    if (idx == KEYSYM_MAP_MISSING) {
+        idx = find_str(strs, num_strs, text);
+        keysym_map_set(map, keysym, idx);
+    }
+
+    return idx;
+}
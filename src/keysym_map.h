@@ -0,0 +1,59 @@
+#ifndef __KEYSYM_MAP_H_INCLUDED__
+#define __KEYSYM_MAP_H_INCLUDED__
+
+#include "label.h"
+
+#include <stdbool.h>
+#include <xkbcommon/xkbcommon.h>
+
+#define KEYSYM_MAP_SIZE    1024 // a power of 2
+#define KEYSYM_MAP_MISSING -2
+
+/**
+ * Open addressing hash map from keysyms to the index of the symbol they type,
+ * or -1 when they type none. It is filled with the symbols' keysyms at mode
+ * enter and the other keysyms are added as they are looked up, so that a key
+ * press is matched without comparing its text to every symbol.
+ *
+ * It maps keysyms, not keycodes, so it stays valid when the keymap changes.
+ */
+struct keysym_map {
+    int          num_entries;
+    xkb_keysym_t keysyms[KEYSYM_MAP_SIZE]; // `XKB_KEY_NoSymbol` when empty
+    short        indices[KEYSYM_MAP_SIZE];
+};
+
+void keysym_map_clear(struct keysym_map *map);
+
+// Returns `KEYSYM_MAP_MISSING` when `keysym` hasn't been added.
+int keysym_map_get(struct keysym_map *map, xkb_keysym_t keysym);
+
+// Does nothing once the map is half full, to keep lookups short.
+void keysym_map_set(struct keysym_map *map, xkb_keysym_t keysym, int idx);
+
+// Maps the keysym typing `s` to `idx` if `s` is a single character.
+void keysym_map_set_str(struct keysym_map *map, char *s, int idx);
+
+void keysym_map_init_label_symbols(
+    struct keysym_map *map, label_symbols_t *label_symbols
+);
+
+/**
+ * `keysym_map_find_label_symbol` returns the index of the symbol typed with
+ * `keysym`, whose text is `text`, or a value < 0. The text is only compared to
+ * the symbols the first time a keysym that isn't in the map is typed.
+ */
+int keysym_map_find_label_symbol(
+    struct keysym_map *map, label_symbols_t *label_symbols,
+    xkb_keysym_t keysym, char *text
+);
+
+void keysym_map_init_strs(struct keysym_map *map, char **strs, int num_strs);
+
+// Same as `keysym_map_find_label_symbol` for the strings `strs`.
+int keysym_map_find_str(
+    struct keysym_map *map, char **strs, int num_strs, xkb_keysym_t keysym,
+    char *text
+);
+
+#endif
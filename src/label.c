@@ -7,7 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-label_symbols_t *label_symbols_from_str(char *s) {
+int label_symbols_size(char *s) {
     char *c = s;
 
     uint32_t r;
@@ -25,22 +25,35 @@ label_symbols_t *label_symbols_from_str(char *s) {
 
     if (c_len < 0) {
         LOG_ERR("Invalid UTF-8 input.");
-        return NULL;
+        return -1;
     }
 
     if (num_symbols < 2) {
         LOG_ERR(
             "Not enough characters (%d). Must have at least 2.", num_symbols
         );
-        return NULL;
+        return -1;
     }
 
     if (num_symbols >= 255) {
         LOG_ERR("Too many characters (%d).", num_symbols);
-        return NULL;
+        return -1;
     }
 
-    label_symbols_t *label_symbols = malloc(len);
+    return len;
+}
+
+label_symbols_t *label_symbols_init(void *buf, char *s) {
+    label_symbols_t *label_symbols = buf;
+
+    uint32_t r;
+    int      c_len;
+    char    *c           = s;
+    int      num_symbols = 0;
+    while ((c_len = str_to_rune(c, &r)) > 0) {
+        c += c_len;
+        num_symbols++;
+    }
 
     label_symbols->num_symbols = num_symbols;
     unsigned char *indices     = (unsigned char *)label_symbols->data;
@@ -61,6 +74,15 @@ label_symbols_t *label_symbols_from_str(char *s) {
     return label_symbols;
 }
 
+label_symbols_t *label_symbols_from_str(char *s) {
+    int len = label_symbols_size(s);
+    if (len < 0) {
+        return NULL;
+    }
+
+    return label_symbols_init(malloc(len), s);
+}
+
 void label_symbols_free(label_symbols_t *ls) {
     free(ls);
 }
@@ -85,9 +107,14 @@ int label_symbols_find_idx(label_symbols_t *label_symbols, char *s) {
     return -1;
 }
 
-label_selection_t *
-label_selection_new(label_symbols_t *label_symbols, int num_labels) {
-    label_selection_t *l = malloc(sizeof(*l) + label_symbols->num_symbols);
+size_t label_selection_size(label_symbols_t *label_symbols) {
+    return sizeof(label_selection_t) + label_symbols->num_symbols;
+}
+
+label_selection_t *label_selection_init(
+    void *buf, label_symbols_t *label_symbols, int num_labels
+) {
+    label_selection_t *l = buf;
 
     l->num_labels = num_labels;
 
@@ -102,6 +129,13 @@ label_selection_new(label_symbols_t *label_symbols, int num_labels) {
     return l;
 }
 
+label_selection_t *
+label_selection_new(label_symbols_t *label_symbols, int num_labels) {
+    return label_selection_init(
+        malloc(label_selection_size(label_symbols)), label_symbols, num_labels
+    );
+}
+
 void label_selection_clear(label_selection_t *label_selection) {
     label_selection->next = 0;
 }
@@ -162,6 +196,45 @@ bool label_selection_is_included(
     return true;
 }
 
+void label_selection_matching(
+    label_selection_t *label_selection, int *first, int *stride
+) {
+    int num_symbols = label_selection->label_symbols->num_symbols;
+
+    *first  = label_selection_to_partial_idx(label_selection);
+    *stride = 1;
+    for (int i = 0; i < label_selection->next; i++) {
+        *stride *= num_symbols;
+    }
+}
+
+int label_selection_prefix_order(
+    label_selection_t *label_selection, int from, int to, int *order
+) {
+    int num_symbols = label_selection->label_symbols->num_symbols;
+    int num_orders  = 1;
+    for (int i = 0; i < label_selection->len; i++) {
+        num_orders *= num_symbols;
+    }
+
+    // `o` has the first symbol as its most significant digit, so the label
+    // index is `o` with its digits reversed.
+    int n = 0;
+    for (int o = 0; o < num_orders; o++) {
+        int idx = 0;
+        for (int i = 0, rest = o; i < label_selection->len; i++) {
+            idx   = idx * num_symbols + rest % num_symbols;
+            rest /= num_symbols;
+        }
+
+        if (idx >= from && idx < to) {
+            order[n++] = idx;
+        }
+    }
+
+    return n;
+}
+
 int label_selection_to_idx(label_selection_t *label_selection) {
     if (label_selection->next != label_selection->len) {
         return -1;
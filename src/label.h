@@ -2,6 +2,7 @@
 #define __LABEL_H_INCLUDED__
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef struct {
     /*         data             data[num_symbols]
@@ -28,6 +29,14 @@ typedef struct {
 // Returns `NULL` upon error.
 label_symbols_t *label_symbols_from_str(char *s);
 
+// Get size of the `label_symbols_t` of a string of characters.
+// Returns value <0 upon error.
+int label_symbols_size(char *s);
+
+// Create a `label_symbols_t` in `buf`, of `label_symbols_size(s)` bytes, from
+// a valid string of characters.
+label_symbols_t *label_symbols_init(void *buf, char *s);
+
 // Free memory of a `label_symbols_t`.
 void label_symbols_free(label_symbols_t *ls);
 
@@ -43,6 +52,17 @@ int label_symbols_find_idx(label_symbols_t *label_symbols, char *s);
 label_selection_t *
 label_selection_new(label_symbols_t *label_symbols, int num_labels);
 
+// Largest size of a `label_selection_t`, to create one on the stack.
+#define LABEL_SELECTION_MAX_SIZE (sizeof(label_selection_t) + 255)
+
+// Get size of a `label_selection_t`.
+size_t label_selection_size(label_symbols_t *label_symbols);
+
+// Create a `label_selection_t` in `buf`, of `label_selection_size` bytes.
+label_selection_t *label_selection_init(
+    void *buf, label_symbols_t *label_symbols, int num_labels
+);
+
 // Clear selection.
 void label_selection_clear(label_selection_t *label_selection);
 
@@ -64,6 +84,20 @@ bool label_selection_is_included(
     label_selection_t *reference, label_selection_t *start
 );
 
+// Get the labels starting with the selection. As labels are encoded with
+// their first symbol as the least significant digit, these are the indices
+// `first`, `first + stride`, `first + 2 * stride`... below `num_labels`.
+void label_selection_matching(
+    label_selection_t *label_selection, int *first, int *stride
+);
+
+// Fill `order` with the labels in [from, to) sorted by their symbols from the
+// first one, so that the labels sharing a prefix are contiguous. Returns the
+// number of labels written.
+int label_selection_prefix_order(
+    label_selection_t *label_selection, int from, int to, int *order
+);
+
 // Returns associated label index.
 int label_selection_to_idx(label_selection_t *label_selection);
 
@@ -1,9 +1,17 @@
+#include "builtin_font.h"
 #include "config.h"
+#include "daemon.h"
+#include "event_loop.h"
 #include "fractional-scale-v1-client-protocol.h"
+#include "input_buffer.h"
+#include "keymap_cache.h"
 #include "log.h"
 #include "mode.h"
+#include "single-pixel-buffer-v1-client-protocol.h"
+#include "solid_buffer.h"
 #include "state.h"
 #include "surface_buffer.h"
+#include "trace.h"
 #include "utils_wayland.h"
 #include "viewporter-client-protocol.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
@@ -12,8 +20,10 @@
 #include "xdg-output-unstable-v1-client-protocol.h"
 
 #include <cairo/cairo.h>
+#include <errno.h>
 #include <getopt.h>
 #include <limits.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -24,71 +34,878 @@
 #include <xkbcommon/xkbcommon-keysyms.h>
 #include <xkbcommon/xkbcommon.h>
 
-static void send_frame_for_overlay(struct overlay_surface *overlay) {
-    struct state *state = overlay->state;
+/**
+ * `damage_rect_to_buffer` converts a rect in the coordinates the modes render in
+ * to the smallest rect of whole pixels of a buffer drawn for `area` covering
+ * it.
+ */
+static struct rect damage_rect_to_buffer(
+    struct rect area, struct surface_buffer *surface_buffer, int32_t scale_120,
+    struct rect rect
+) {
+    rect.x -= area.x;
+    rect.y -= area.y;
+
+    double scale = scale_120 / 120.0;
+    int    x0    = floor(rect.x * scale);
+    int    y0    = floor(rect.y * scale);
+    int    x1    = ceil((rect.x + rect.w) * scale);
+    int    y1    = ceil((rect.y + rect.h) * scale);
+
+    return rect_intersection(
+        (struct rect){.x = x0, .y = y0, .w = x1 - x0, .h = y1 - y0},
+        (struct rect){
+            .x = 0,
+            .y = 0,
+            .w = surface_buffer->width,
+            .h = surface_buffer->height,
+        }
+    );
+}
 
-    int32_t scale_120 = overlay->fractional_scale_val;
-    if (scale_120 == 0) {
-        // Fall back to the output's integer scale if fractional scale not yet received.
-        scale_120 = (overlay->output == NULL ? 1 : overlay->output->scale) * 120;
+// Lowest scale, times 120, overlays are rendered at to stay in the budget.
+#define MIN_BUDGET_SCALE_120 30
+
+static size_t buffer_size(struct rect rect, int32_t scale_120) {
+    return (size_t)(rect.w * scale_120 / 120) * 4 * (rect.h * scale_120 / 120);
+}
+
+// Size of the buffers of all the overlays.
+static size_t shm_used(struct state *state) {
+    size_t                  used = 0;
+    struct overlay_surface *overlay;
+    wl_list_for_each (overlay, &state->overlay_surfaces, link) {
+        used += surface_buffer_pool_shm_size(&overlay->surface_buffer_pool);
+        used += surface_buffer_pool_shm_size(&overlay->speculation_pool);
+    }
+
+    return used;
+}
+
+/**
+ * `fit_scale_to_budget` lowers `scale_120` so that the next buffer of the
+ * overlay's content, drawn for `area`, keeps the buffers of all the overlays
+ * under `general.max_shm_bytes`. Returns false when the frame should rather
+ * wait for a busy buffer to be released than allocate another one.
+ */
+static bool fit_scale_to_budget(
+    struct overlay_surface *overlay, struct rect area, int32_t *scale_120
+) {
+    struct state *state  = overlay->state;
+    size_t        budget = state->config.general.max_shm_bytes;
+    if (budget == 0) {
+        return true;
+    }
+
+    size_t used = shm_used(state);
+
+    struct surface_buffer_pool *pool = &overlay->surface_buffer_pool;
+    struct surface_buffer      *next = surface_buffer_pool_next(
+        pool, area.w * *scale_120 / 120, area.h * *scale_120 / 120
+    );
+    if (next == NULL) {
+        return true;
+    }
+
+    // The next buffer is replaced when its size changes.
+    used             -= next->data_size;
+    size_t available  = budget > used ? budget - used : 0;
+
+    if (buffer_size(area, *scale_120) <= available) {
+        return true;
     }
 
+    // Only busy buffers are allocated. Rather than adding a buffer at a lower
+    // scale, wait for them.
+    if (next->state == SURFACE_BUFFER_UNINITIALIZED &&
+        surface_buffer_pool_shm_size(pool) > 0) {
+        return false;
+    }
+
+    while (*scale_120 > MIN_BUDGET_SCALE_120 &&
+           buffer_size(area, *scale_120) > available) {
+        (*scale_120)--;
+    }
+
+    LOG_DEBUG(
+        "Rendering at scale %.3f to fit the SHM budget.", *scale_120 / 120.0
+    );
+    return true;
+}
+
+/**
+ * `overlay_surface_rect` returns the overlay's area in the coordinates the
+ * modes render in.
+ */
+static struct rect overlay_surface_rect(struct overlay_surface *overlay) {
+    return (struct rect){
+        .x = overlay->x,
+        .y = overlay->y,
+        .w = overlay->width,
+        .h = overlay->height,
+    };
+}
+
+/**
+ * `set_overlay_part` places `part` over `rect` of the overlay, showing
+ * `wl_buffer` stretched over it, and commits it. Empty parts are hidden.
+ * `opaque` tells whether the buffer is fully opaque so that the compositor can
+ * skip what's below.
+ */
+static void set_overlay_part(
+    struct overlay_surface *overlay, struct overlay_part *part,
+    struct rect rect, struct wl_buffer *wl_buffer, bool opaque
+) {
+    if (rect.w <= 0 || rect.h <= 0) {
+        wl_buffer = NULL;
+        rect      = (struct rect){0, 0, 0, 0};
+    }
+
+    if (rect_equals(rect, part->rect) && wl_buffer == part->wl_buffer) {
+        return;
+    }
+
+    if (wl_buffer != part->wl_buffer) {
+        wl_surface_attach(part->wl_surface, wl_buffer, 0, 0);
+        if (wl_buffer != NULL) {
+            wl_surface_damage_buffer(part->wl_surface, 0, 0, 1, 1);
+        }
+    }
+
+    if (wl_buffer != NULL) {
+        struct rect surface_rect = overlay_surface_rect(overlay);
+        wl_subsurface_set_position(
+            part->wl_subsurface, rect.x - surface_rect.x,
+            rect.y - surface_rect.y
+        );
+        wp_viewport_set_destination(part->wp_viewport, rect.w, rect.h);
+
+        struct wl_region *region = NULL;
+        if (opaque) {
+            region = wl_compositor_create_region(overlay->state->wl_compositor);
+            wl_region_add(region, 0, 0, rect.w, rect.h);
+        }
+        wl_surface_set_opaque_region(part->wl_surface, region);
+        if (region != NULL) {
+            wl_region_destroy(region);
+        }
+    }
+
+    wl_surface_commit(part->wl_surface);
+
+    part->rect      = rect;
+    part->wl_buffer = wl_buffer;
+}
+
+/**
+ * `set_overlay_background` shows `wl_buffer` over the parts of `surface_rect`
+ * outside of `content`, which must be included in it.
+ */
+static void set_overlay_background(
+    struct overlay_surface *overlay, struct rect surface_rect,
+    struct rect content, struct wl_buffer *wl_buffer, bool opaque
+) {
+    struct rect *s = &surface_rect;
+    struct rect *c = &content;
+    if (c->w <= 0 || c->h <= 0) {
+        *c = (struct rect){s->x, s->y, 0, 0};
+    }
+
+    // Full width above and below the content, its height on its sides.
+    struct rect parts[OVERLAY_NUM_BACKGROUND_PARTS] = {
+        {s->x, s->y, s->w, c->y - s->y},
+        {s->x, c->y + c->h, s->w, s->y + s->h - c->y - c->h},
+        {s->x, c->y, c->x - s->x, c->h},
+        {c->x + c->w, c->y, s->x + s->w - c->x - c->w, c->h},
+    };
+
+    for (int i = 0; i < OVERLAY_NUM_BACKGROUND_PARTS; i++) {
+        set_overlay_part(
+            overlay, &overlay->background[i], parts[i], wl_buffer, opaque
+        );
+    }
+}
+
+/**
+ * `commit_content_buffer` shows the part of `surface_buffer`, drawn for `area`,
+ * under the current `content` rect on the overlay's content subsurface.
+ */
+static void commit_content_buffer(
+    struct overlay_surface *overlay, struct surface_buffer *surface_buffer,
+    struct rect area, int32_t scale_120
+) {
+    struct rect          content = overlay->content.rect;
+    struct overlay_part *part    = &overlay->content;
+    wl_surface_set_buffer_scale(part->wl_surface, 1);
+    wl_surface_attach(part->wl_surface, surface_buffer->wl_buffer, 0, 0);
+
+    struct rect surface_rect = overlay_surface_rect(overlay);
+    wl_subsurface_set_position(
+        part->wl_subsurface, content.x - surface_rect.x,
+        content.y - surface_rect.y
+    );
+
+    // The source must not go past the buffer, whose size was rounded down.
+    double     scale = scale_120 / 120.0;
+    wl_fixed_t x     = wl_fixed_from_double((content.x - area.x) * scale);
+    wl_fixed_t y     = wl_fixed_from_double((content.y - area.y) * scale);
+    wl_fixed_t w     = min(
+        wl_fixed_from_double(content.w * scale),
+        wl_fixed_from_int(surface_buffer->width) - x
+    );
+    wl_fixed_t h = min(
+        wl_fixed_from_double(content.h * scale),
+        wl_fixed_from_int(surface_buffer->height) - y
+    );
+    wp_viewport_set_source(part->wp_viewport, x, y, w, h);
+    wp_viewport_set_destination(part->wp_viewport, content.w, content.h);
+
+    if (overlay->damage.full) {
+        wl_surface_damage_buffer(
+            part->wl_surface, 0, 0, surface_buffer->width,
+            surface_buffer->height
+        );
+    } else {
+        for (int i = 0; i < overlay->damage.num_rects; i++) {
+            struct rect r = damage_rect_to_buffer(
+                area, surface_buffer, scale_120, overlay->damage.rects[i]
+            );
+            wl_surface_damage_buffer(part->wl_surface, r.x, r.y, r.w, r.h);
+        }
+    }
+    damage_clear(&overlay->damage);
+
+    wl_surface_commit(part->wl_surface);
+}
+
+/**
+ * A frame of an overlay being sent. Frames are prepared and committed on the
+ * main thread while their content is rendered concurrently.
+ */
+struct overlay_frame {
+    struct overlay_surface *overlay;
+    int32_t                 scale_120;
+    struct rect             surface_rect;
+    struct wl_buffer       *bg_buffer;
+    uint32_t                bg_color;
+    struct rect             area;   // `buffer` is drawn for
+    struct surface_buffer  *buffer; // to render in, NULL if there is none
+    struct damage           damage; // of `buffer`, to redraw
+    struct rect             clip;   // extents of `damage` in `area`
+};
+
+/**
+ * `prepare_overlay_content` gets a buffer for the overlay's `content` and the
+ * areas of it to redraw. Returns false when no buffer is available.
+ */
+static bool prepare_overlay_content(
+    struct overlay_surface *overlay, struct overlay_frame *frame
+) {
+    struct state *state = overlay->state;
+    struct rect   area  = frame->area;
+
     struct surface_buffer *surface_buffer = get_next_buffer(
         state->wl_shm, &overlay->surface_buffer_pool,
-        overlay->width * scale_120 / 120, overlay->height * scale_120 / 120
+        area.w * frame->scale_120 / 120, area.h * frame->scale_120 / 120
     );
     if (surface_buffer == NULL) {
-        return;
+        return false;
     }
     surface_buffer->state = SURFACE_BUFFER_BUSY;
 
-    cairo_t *cairo = surface_buffer->cairo;
+    // The buffer only needs to be redrawn where it differs from the last
+    // state.
+    struct damage *buffer_damage = &surface_buffer->damage;
+    frame->buffer                = surface_buffer;
+    frame->clip                  = area;
+    if (buffer_damage->full) {
+        damage_set_full(&overlay->damage);
+        frame->damage = *buffer_damage;
+        damage_clear(buffer_damage);
+        return true;
+    }
+
+    // What isn't shown of the buffer is left outdated until it is. The pixels
+    // around the content are redrawn with it as they may be blended with its
+    // edges.
+    struct rect shown = damage_rect_to_buffer(
+        area, surface_buffer, frame->scale_120, overlay->content.rect
+    );
+    shown = (struct rect){shown.x - 1, shown.y - 1, shown.w + 2, shown.h + 2};
+
+    struct damage pending;
+    damage_clear(&pending);
+    damage_clear(&frame->damage);
+    for (int i = 0; i < buffer_damage->num_rects; i++) {
+        struct rect r      = buffer_damage->rects[i];
+        struct rect pixels = damage_rect_to_buffer(
+            area, surface_buffer, frame->scale_120, r
+        );
+        if (rect_intersects(pixels, shown)) {
+            damage_add(&frame->damage, r);
+        } else if (pixels.w > 0 && pixels.h > 0) {
+            damage_add(&pending, r);
+        }
+    }
+    *buffer_damage = pending;
+
+    // The modes can skip what's up to date.
+    frame->clip = rect_intersection(area, damage_extents(&frame->damage));
+
+    return true;
+}
+
+/**
+ * `set_up_render_context` clips `cairo` to the frame's damage within `band`, in
+ * buffer pixels, and transforms it to the coordinates the modes render in. The
+ * clip is aligned on buffer pixels so that its edges are not blended with the
+ * outdated content.
+ */
+static void set_up_render_context(
+    cairo_t *cairo, struct overlay_frame *frame, struct rect band
+) {
+    struct overlay_surface *overlay = frame->overlay;
+
     cairo_identity_matrix(cairo);
-    cairo_scale(cairo, scale_120 / 120.0, scale_120 / 120.0);
+    cairo_reset_clip(cairo);
+    if (frame->damage.full) {
+        cairo_rectangle(cairo, band.x, band.y, band.w, band.h);
+    } else {
+        for (int i = 0; i < frame->damage.num_rects; i++) {
+            struct rect r = rect_intersection(
+                damage_rect_to_buffer(
+                    frame->area, frame->buffer, frame->scale_120,
+                    frame->damage.rects[i]
+                ),
+                band
+            );
+            if (r.w > 0 && r.h > 0) {
+                cairo_rectangle(cairo, r.x, r.y, r.w, r.h);
+            }
+        }
+    }
+    cairo_clip(cairo);
+
+    cairo_scale(cairo, frame->scale_120 / 120.0, frame->scale_120 / 120.0);
+    cairo_translate(cairo, -frame->area.x, -frame->area.y);
+}
 
-    // In all-outputs mode, translate so global coordinates rendered by the mode
-    // map to this output's local surface coordinates.
-    if (state->config.general.all_outputs && overlay->output != NULL) {
-        cairo_translate(cairo, -overlay->output->x, -overlay->output->y);
+static int32_t overlay_scale_120(struct overlay_surface *overlay) {
+    if (overlay->fractional_scale_val == 0) {
+        // Fall back to the output's integer scale if fractional scale not yet received.
+        return (overlay->output == NULL ? 1 : overlay->output->scale) * 120;
     }
 
-    mode_render(state, cairo);
+    return overlay->fractional_scale_val;
+}
 
-    wl_surface_set_buffer_scale(overlay->wl_surface, 1);
-    wl_surface_attach(overlay->wl_surface, surface_buffer->wl_buffer, 0, 0);
-    wp_viewport_set_destination(overlay->wp_viewport, overlay->width, overlay->height);
-    wl_surface_damage(overlay->wl_surface, 0, 0, overlay->width, overlay->height);
-    wl_surface_commit(overlay->wl_surface);
+// Number of pixels of a 4K output. With `render_scale=auto`, larger contents
+// are rendered at a lower scale.
+#define AUTO_RENDER_SCALE_MAX_PIXELS (3840 * 2160)
+
+/**
+ * `render_scale_120` returns the scale, times 120, the overlay's `content` is
+ * rendered at following `general.render_scale`. The viewport scales its
+ * buffers up to the output's scale.
+ */
+static int32_t
+render_scale_120(struct overlay_surface *overlay, struct rect content) {
+    int32_t scale_120    = overlay_scale_120(overlay);
+    double  render_scale = overlay->state->config.general.render_scale;
+    if (render_scale != 0) {
+        return max(scale_120 * render_scale, 1);
+    }
+
+    double pixels = (double)buffer_size(content, scale_120) / 4;
+    if (pixels <= AUTO_RENDER_SCALE_MAX_PIXELS) {
+        return scale_120;
+    }
+
+    // Never below a buffer pixel per logical pixel.
+    int32_t auto_scale_120 =
+        scale_120 * sqrt(AUTO_RENDER_SCALE_MAX_PIXELS / pixels);
+    return max(auto_scale_120, min(scale_120, 120));
+}
+
+/**
+ * `overlay_content_rect` returns the area of the overlay the mode draws more
+ * than its background in, setting `bg_buffer` to a solid buffer of the
+ * background's `bg_color`. When the background can't be shown with a solid
+ * buffer, it returns the whole overlay and sets `bg_buffer` to NULL.
+ */
+static struct rect overlay_content_rect(
+    struct overlay_surface *overlay, struct wl_buffer **bg_buffer,
+    uint32_t *bg_color
+) {
+    struct rect surface_rect = overlay_surface_rect(overlay);
+    struct rect content      = surface_rect;
+    *bg_buffer               = NULL;
+    *bg_color                = 0;
+    if (mode_content_bounds(overlay->state, &content, bg_color)) {
+        *bg_buffer = solid_buffer_cache_get(&overlay->solid_buffers, *bg_color);
+    }
+
+    if (*bg_buffer == NULL) {
+        return surface_rect;
+    }
+
+    return rect_intersection(content, surface_rect);
+}
+
+/**
+ * `overlay_buffer_area` returns the area the buffers of the overlay's
+ * `content` are drawn for. The content only shows its part of them, so that
+ * they are kept as it shrinks, and only sized to it again when it outgrows
+ * them or another mode is entered.
+ */
+static struct rect
+overlay_buffer_area(struct overlay_surface *overlay, struct rect content) {
+    struct rect area = overlay->buffer_area;
+    if (overlay->buffer_area_mode == overlay->state->current_mode &&
+        rect_equals(rect_intersection(content, area), content)) {
+        return area;
+    }
+
+    return content;
+}
+
+// Frames are rendered in bands of at least this many pixels in parallel, and
+// frames ahead a band at a time.
+#define RENDER_BAND_MIN_PIXELS (512 * 1024)
+
+static void reset_speculation(struct overlay_surface *overlay) {
+    for (int i = 0; i < SURFACE_BUFFER_POOL_MAX_SIZE; i++) {
+        overlay->speculative_frames[i].ready = false;
+    }
+    overlay->speculation.slot = -1;
+
+    overlay->next_candidate =
+        overlay->state->config.general.speculative_frames > 0 ? 0 : -1;
+}
+
+/**
+ * `show_speculative_frame` shows the frame rendered ahead for the mode's
+ * current state, if any. Returns false when there is none.
+ */
+static bool
+show_speculative_frame(struct overlay_surface *overlay, int32_t scale_120) {
+    uint64_t frame_id = mode_frame_id(overlay->state);
+
+    for (int i = 0; i < overlay->speculation_pool.size; i++) {
+        struct speculative_frame *frame = &overlay->speculative_frames[i];
+        struct surface_buffer    *buffer =
+            &overlay->speculation_pool.buffers[i];
+        if (!frame->ready || frame->frame_id != frame_id ||
+            frame->scale_120 != scale_120 ||
+            !rect_equals(frame->content, overlay->content.rect) ||
+            buffer->state != SURFACE_BUFFER_READY) {
+            continue;
+        }
+
+        trace_instant("speculative_frame_hit");
+
+        buffer->state = SURFACE_BUFFER_BUSY;
+        damage_set_full(&overlay->damage);
+        commit_content_buffer(overlay, buffer, frame->content, scale_120);
+        return true;
+    }
+
+    return false;
 }
 
 /**
- * Send a 1x1px transparent surface to trigger the `surface.enter()` event.
- * Only needed for single-output mode when the output is not yet known.
+ * `start_speculation` picks the overlay's next candidate key and a free buffer
+ * of its speculation pool to render its frame in. Returns false when there is
+ * nothing to render for now.
  */
-static void send_transparent_frame_to_overlay(struct overlay_surface *overlay) {
+static bool start_speculation(struct overlay_surface *overlay) {
     struct state *state = overlay->state;
 
-    struct surface_buffer *surface_buffer =
-        get_next_buffer(state->wl_shm, &overlay->surface_buffer_pool, 1, 1);
-    if (surface_buffer == NULL) {
+    int slot = -1;
+    for (int i = 0; i < overlay->speculation_pool.size; i++) {
+        if (!overlay->speculative_frames[i].ready &&
+            overlay->speculation_pool.buffers[i].state != SURFACE_BUFFER_BUSY) {
+            slot = i;
+            break;
+        }
+    }
+
+    int candidate = overlay->next_candidate++;
+    if (slot < 0 || candidate >= mode_num_candidates(state)) {
+        overlay->next_candidate = -1;
+        return false;
+    }
+
+    uint64_t base_frame_id = mode_frame_id(state);
+    if (!mode_select_candidate(state, candidate)) {
+        return false;
+    }
+
+    struct wl_buffer *bg_buffer;
+    uint32_t          bg_color;
+    struct rect       content =
+        overlay_content_rect(overlay, &bg_buffer, &bg_color);
+    int32_t scale_120 =
+        render_scale_120(overlay, overlay_buffer_area(overlay, content));
+    mode_select_candidate(state, -1);
+
+    // Frames ahead are not worth exceeding the budget.
+    size_t budget = state->config.general.max_shm_bytes;
+    size_t size   = buffer_size(content, scale_120);
+    if (content.w <= 0 || content.h <= 0 ||
+        (budget != 0 && shm_used(state) + size > budget)) {
+        return false;
+    }
+
+    overlay->speculation = (struct speculative_render){
+        .slot          = slot,
+        .candidate     = candidate,
+        .base_frame_id = base_frame_id,
+        .content       = content,
+        .scale_120     = scale_120,
+    };
+    return true;
+}
+
+/**
+ * `speculate_overlay` renders the next band of the frame of the overlay's next
+ * candidate key. Each call is short so that a key press never waits for a
+ * whole frame rendered ahead.
+ */
+static void speculate_overlay(struct overlay_surface *overlay) {
+    struct state              *state  = overlay->state;
+    struct speculative_render *render = &overlay->speculation;
+    if (render->slot < 0 && !start_speculation(overlay)) {
         return;
     }
-    surface_buffer->state = SURFACE_BUFFER_BUSY;
-    cairo_t *cairo        = surface_buffer->cairo;
-    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
-    cairo_set_source_rgba(cairo, 0, 0, 0, 0);
-    cairo_fill(cairo);
-    wl_surface_attach(overlay->wl_surface, surface_buffer->wl_buffer, 0, 0);
-    wp_viewport_set_destination(overlay->wp_viewport, overlay->width, overlay->height);
-    wl_surface_damage(overlay->wl_surface, 0, 0, 1, 1);
+
+    // The frame is dropped if the mode moved on since it was started.
+    if (mode_frame_id(state) != render->base_frame_id) {
+        render->slot = -1;
+        return;
+    }
+
+    struct rect            content   = render->content;
+    int32_t                scale_120 = render->scale_120;
+    struct surface_buffer *buffer    = get_buffer(
+        state->wl_shm, &overlay->speculation_pool, render->slot,
+        content.w * scale_120 / 120, content.h * scale_120 / 120
+    );
+    if (buffer == NULL) {
+        render->slot = -1;
+        return;
+    }
+
+    if (buffer->data != render->data) {
+        render->data     = buffer->data;
+        render->next_row = 0;
+    }
+
+    if (!mode_select_candidate(state, render->candidate)) {
+        render->slot = -1;
+        return;
+    }
+
+    TRACE_BEGIN(render_start);
+
+    uint32_t rows = max(RENDER_BAND_MIN_PIXELS / buffer->width, 1);
+    uint32_t y0   = render->next_row;
+    uint32_t y1   = min(y0 + rows, buffer->height);
+
+    // The clip lets the modes draw with pixman.
+    cairo_t *cairo = buffer->cairo;
+    cairo_identity_matrix(cairo);
+    cairo_reset_clip(cairo);
+    cairo_rectangle(cairo, 0, y0, buffer->width, y1 - y0);
+    cairo_clip(cairo);
+    cairo_scale(cairo, scale_120 / 120.0, scale_120 / 120.0);
+    cairo_translate(cairo, -content.x, -content.y);
+
+    // The modes only draw what's in the band's rows.
+    double      scale  = scale_120 / 120.0;
+    int         top    = content.y + floor(y0 / scale);
+    int         bottom = content.y + ceil(y1 / scale);
+    struct rect clip   = rect_intersection(
+        content, (struct rect){content.x, top, content.w, bottom - top}
+    );
+    mode_render(state, cairo, clip);
+
+    uint64_t frame_id = mode_frame_id(state);
+    mode_select_candidate(state, -1);
+
+    render->next_row = y1;
+    if (y1 == buffer->height) {
+        overlay->speculative_frames[render->slot] = (struct speculative_frame){
+            .ready     = true,
+            .frame_id  = frame_id,
+            .content   = content,
+            .scale_120 = scale_120,
+        };
+        render->slot = -1;
+    }
+
+    TRACE_END("speculative_render", render_start);
+}
+
+/**
+ * `next_speculating_overlay` returns an idle overlay with frames left to
+ * render ahead or NULL.
+ */
+static struct overlay_surface *next_speculating_overlay(struct state *state) {
+    struct overlay_surface *overlay;
+    wl_list_for_each (overlay, &state->overlay_surfaces, link) {
+        if (overlay->next_candidate >= 0 &&
+            overlay->wl_surface_callback == NULL && !overlay->redraw_pending) {
+            return overlay;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * `prepare_frame` sets up the overlay's next frame. Returns false when it
+ * can't be sent yet.
+ */
+static bool
+prepare_frame(struct overlay_surface *overlay, struct overlay_frame *frame) {
+    *frame = (struct overlay_frame){
+        .overlay      = overlay,
+        .surface_rect = overlay_surface_rect(overlay),
+    };
+
+    // Only the area where the mode draws more than its background is shown,
+    // as long as the background can be shown with a solid buffer.
+    struct rect content =
+        overlay_content_rect(overlay, &frame->bg_buffer, &frame->bg_color);
+    frame->area      = overlay_buffer_area(overlay, content);
+    frame->scale_120 = render_scale_120(overlay, frame->area);
+
+    bool has_content = content.w > 0 && content.h > 0;
+    if (has_content &&
+        !fit_scale_to_budget(overlay, frame->area, &frame->scale_120)) {
+        // Another buffer would exceed the budget.
+        overlay->redraw_pending = true;
+        return false;
+    }
+
+    if (has_content) {
+        if (!rect_equals(frame->area, overlay->buffer_area)) {
+            // The buffers' content is at another position.
+            struct damage damage;
+            damage_set_full(&damage);
+            surface_buffer_pool_add_damage(
+                &overlay->surface_buffer_pool, &damage
+            );
+        }
+        overlay->buffer_area      = frame->area;
+        overlay->buffer_area_mode = overlay->state->current_mode;
+    }
+
+    if (!rect_equals(content, overlay->content.rect)) {
+        // Another part of the buffers is shown.
+        damage_set_full(&overlay->damage);
+    }
+    struct rect prev_content = overlay->content.rect;
+    overlay->content.rect    = content;
+
+    if (has_content) {
+        if (show_speculative_frame(overlay, frame->scale_120)) {
+            return true;
+        }
+
+        if (!prepare_overlay_content(overlay, frame)) {
+            // All buffers are held by the compositor. The frame is sent as
+            // soon as one is released.
+            overlay->content.rect   = prev_content;
+            overlay->redraw_pending = true;
+            return false;
+        }
+    } else if (!rect_equals(prev_content, content)) {
+        wl_surface_attach(overlay->content.wl_surface, NULL, 0, 0);
+        wl_surface_commit(overlay->content.wl_surface);
+    }
+
+    return true;
+}
+
+/**
+ * A band of rows of a frame's buffer, rendered with its own cairo context so
+ * that the bands of large frames are rendered in parallel.
+ */
+struct render_band {
+    struct overlay_frame *frame;
+    struct rect           rect; // in buffer pixels
+};
+
+/**
+ * `split_frame_in_bands` adds the bands of at most `max_bands` that `frame` is
+ * rendered in to `bands`. Returns their number.
+ */
+static int split_frame_in_bands(
+    struct overlay_frame *frame, int max_bands, struct render_band *bands
+) {
+    struct surface_buffer *buffer = frame->buffer;
+    struct rect            whole  = {0, 0, buffer->width, buffer->height};
+
+    // Only the rows with damage are split.
+    struct rect area = damage_rect_to_buffer(
+        frame->area, buffer, frame->scale_120, frame->clip
+    );
+    int num_bands = (int64_t)area.w * area.h / RENDER_BAND_MIN_PIXELS;
+    num_bands     = min(min(num_bands, max_bands), area.h);
+    if (num_bands <= 1) {
+        bands[0] = (struct render_band){.frame = frame, .rect = whole};
+        return 1;
+    }
+
+    for (int i = 0; i < num_bands; i++) {
+        int y0   = area.y + area.h * i / num_bands;
+        int y1   = area.y + area.h * (i + 1) / num_bands;
+        bands[i] = (struct render_band){
+            .frame = frame,
+            .rect  = {.x = 0, .y = y0, .w = buffer->width, .h = y1 - y0},
+        };
+    }
+
+    return num_bands;
+}
+
+static void render_band(void *data, int i) {
+    struct render_band    *band   = &((struct render_band *)data)[i];
+    struct overlay_frame  *frame  = band->frame;
+    struct surface_buffer *buffer = frame->buffer;
+
+    cairo_t *cairo = buffer->cairo;
+    if (band->rect.h < (int32_t)buffer->height) {
+        // A context over the band's rows only, as cairo surfaces can't be
+        // drawn to from several threads.
+        int stride = cairo_image_surface_get_stride(buffer->cairo_surface);
+        cairo_surface_t *surface = cairo_image_surface_create_for_data(
+            (unsigned char *)buffer->data + band->rect.y * stride,
+            cairo_image_surface_get_format(buffer->cairo_surface),
+            buffer->width, band->rect.h, stride
+        );
+        cairo_surface_set_device_offset(surface, 0, -band->rect.y);
+        cairo = cairo_create(surface);
+        cairo_surface_destroy(surface);
+    }
+
+    set_up_render_context(cairo, frame, band->rect);
+
+    // The modes only draw what's in the band's rows.
+    struct rect clip   = frame->clip;
+    double      scale  = frame->scale_120 / 120.0;
+    int         bottom = band->rect.y + band->rect.h;
+    int         y0     = frame->area.y + floor(band->rect.y / scale);
+    int         y1     = frame->area.y + ceil(bottom / scale);
+    clip               = rect_intersection(
+        clip, (struct rect){.x = clip.x, .y = y0, .w = clip.w, .h = y1 - y0}
+    );
+
+    TRACE_BEGIN(render_start);
+    mode_render(frame->overlay->state, cairo, clip);
+    TRACE_END("mode_render", render_start);
+
+    if (cairo != buffer->cairo) {
+        cairo_surface_flush(cairo_get_target(cairo));
+        cairo_destroy(cairo);
+    }
+}
+
+static void commit_frame(struct overlay_frame *frame) {
+    struct overlay_surface *overlay = frame->overlay;
+    if (frame->buffer != NULL) {
+        commit_content_buffer(
+            overlay, frame->buffer, frame->area, frame->scale_120
+        );
+    }
+    overlay->redraw_pending = false;
+    reset_speculation(overlay);
+
+    set_overlay_background(
+        overlay, frame->surface_rect, overlay->content.rect, frame->bg_buffer,
+        (frame->bg_color & 0xff) == 0xff
+    );
+
+    // Subsurfaces' state is applied with their parent's.
+    trace_instant("wl_surface_commit");
     wl_surface_commit(overlay->wl_surface);
 }
 
+/**
+ * `send_due_frames` sends the frames of the overlays that are due, rendering
+ * them in parallel, so that the outputs are updated together.
+ */
+static void send_due_frames(struct state *state) {
+    int num_overlays = wl_list_length(&state->overlay_surfaces);
+    if (num_overlays == 0) {
+        return;
+    }
+
+    struct overlay_frame    frames[num_overlays];
+    int                     num_frames = 0;
+    struct overlay_surface *overlay;
+    wl_list_for_each (overlay, &state->overlay_surfaces, link) {
+        if (overlay->frame_due) {
+            overlay->frame_due = false;
+            if (prepare_frame(overlay, &frames[num_frames])) {
+                num_frames++;
+            }
+        }
+    }
+
+    int                max_bands = state->render_pool.num_threads + 1;
+    struct render_band bands[num_frames * max_bands + 1];
+    int                num_bands = 0;
+    for (int i = 0; i < num_frames; i++) {
+        if (frames[i].buffer != NULL) {
+            num_bands +=
+                split_frame_in_bands(&frames[i], max_bands, &bands[num_bands]);
+        }
+    }
+
+    TRACE_BEGIN(render_start);
+    render_pool_run(&state->render_pool, render_band, bands, num_bands);
+    TRACE_END("render_frames", render_start);
+
+    for (int i = 0; i < num_frames; i++) {
+        commit_frame(&frames[i]);
+    }
+}
+
+/**
+ * `attach_overlay_buffer` stretches a transparent buffer over the overlay
+ * surface. Its content is drawn on subsurfaces.
+ */
+static void attach_overlay_buffer(struct overlay_surface *overlay) {
+    struct wl_buffer *wl_buffer =
+        solid_buffer_cache_get(&overlay->solid_buffers, 0);
+    if (wl_buffer == NULL) {
+        return;
+    }
+
+    wl_surface_attach(overlay->wl_surface, wl_buffer, 0, 0);
+    wl_surface_damage_buffer(overlay->wl_surface, 0, 0, 1, 1);
+    wp_viewport_set_destination(
+        overlay->wp_viewport, overlay->width, overlay->height
+    );
+}
+
+static void handle_buffer_released(void *data) {
+    struct overlay_surface *overlay = data;
+
+    // When a frame callback is pending, the frame is sent when it's done.
+    if (overlay->redraw_pending && overlay->wl_surface_callback == NULL) {
+        overlay->frame_due = true;
+    }
+}
+
 static void surface_callback_done(
     void *data, struct wl_callback *callback, uint32_t callback_data
 ) {
     struct overlay_surface *overlay = data;
-    send_frame_for_overlay(overlay);
+    overlay->frame_due              = true;
 
     wl_callback_destroy(overlay->wl_surface_callback);
     overlay->wl_surface_callback = NULL;
@@ -98,6 +915,70 @@ const struct wl_callback_listener surface_callback_listener = {
     .done = surface_callback_done,
 };
 
+/**
+ * `release_idle_buffers` frees the overlays' buffers that are no longer used.
+ * Returns the time in ms until it should be called again or -1.
+ */
+static int release_idle_buffers(struct state *state) {
+    int                     timeout = -1;
+    struct overlay_surface *overlay;
+    wl_list_for_each (overlay, &state->overlay_surfaces, link) {
+        struct surface_buffer_pool *pools[] = {
+            &overlay->surface_buffer_pool,
+            &overlay->speculation_pool,
+        };
+        for (size_t i = 0; i < sizeof(pools) / sizeof(pools[0]); i++) {
+            int next_in = surface_buffer_pool_release_idle(pools[i]);
+            if (next_in >= 0 && (timeout < 0 || next_in < timeout)) {
+                timeout = next_in;
+            }
+        }
+    }
+
+    return timeout;
+}
+
+/**
+ * `read_input` reads the floating mode's areas as they come in so that the
+ * overlay doesn't have to wait for them before showing up.
+ */
+static void read_input(void *data, int fd, uint32_t events) {
+    struct state *state = data;
+    if (input_buffer_read(&state->input_buffer, fd)) {
+        event_loop_remove_fd(&state->event_loop, fd);
+    }
+}
+
+/**
+ * `reads_input` returns whether one of the loaded modes takes its areas from
+ * `input`.
+ */
+static bool reads_input(struct state *state) {
+    if (state->config.mode_floating.source != FLOATING_MODE_SOURCE_STDIN) {
+        return false;
+    }
+
+    for (int i = 0; i < MAX_NUM_MODES && state->mode_interfaces[i] != NULL;
+         i++) {
+        if (strcmp(state->mode_interfaces[i]->name, "floating") == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * `add_damage` marks the given areas to be redrawn on all the overlays.
+ */
+static void add_damage(struct state *state, struct damage *damage) {
+    struct overlay_surface *overlay;
+    wl_list_for_each (overlay, &state->overlay_surfaces, link) {
+        damage_add_damage(&overlay->damage, damage);
+        surface_buffer_pool_add_damage(&overlay->surface_buffer_pool, damage);
+    }
+}
+
 static void request_frame(struct state *state) {
     struct overlay_surface *overlay;
     wl_list_for_each (overlay, &state->overlay_surfaces, link) {
@@ -108,6 +989,7 @@ static void request_frame(struct state *state) {
         wl_callback_add_listener(
             overlay->wl_surface_callback, &surface_callback_listener, overlay
         );
+        trace_instant("wl_surface_commit");
         wl_surface_commit(overlay->wl_surface);
     }
 }
@@ -174,7 +1056,7 @@ bool compute_initial_area(struct state *state, struct rect *initial_area) {
 
 static void noop() {}
 
-static void load_home_row(
+static bool load_home_row(
     struct xkb_keymap *keymap, char **home_row, char *home_row_buffer
 ) {
     static const xkb_keycode_t key_codes[] = {
@@ -201,7 +1083,8 @@ static void load_home_row(
         int char_len = xkb_keysym_to_utf8(keysym, buffer, buffer_size);
         if (char_len < 0) {
             LOG_ERR("Could not load home row keys. Buffer is too small.");
-            exit(1);
+            xkb_state_unref(xkb_state);
+            return false;
         }
 
         if (char_len == 0) {
@@ -210,7 +1093,8 @@ static void load_home_row(
                 "keymap.",
                 key_codes[i]
             );
-            exit(1);
+            xkb_state_unref(xkb_state);
+            return false;
         }
 
         home_row[i]  = buffer;
@@ -219,6 +1103,92 @@ static void load_home_row(
     }
 
     xkb_state_unref(xkb_state);
+    return true;
+}
+
+static void update_home_row_map(struct state *state) {
+    if (state->home_row == state->keymap_home_row &&
+        !state->keymap_home_row_invalid) {
+        keysym_map_init_strs(
+            &state->home_row_map, state->home_row, HOME_ROW_LEN_WITH_BTN
+        );
+    }
+}
+
+_Static_assert(
+    KEYMAP_CACHE_HOME_ROW_LEN == HOME_ROW_LEN_WITH_BTN &&
+        KEYMAP_CACHE_HOME_ROW_BUF == HOME_ROW_BUFFER_LEN,
+    "The keymap cache's home row must match the state's."
+);
+
+static void
+load_cached_home_row(struct state *state, struct keymap_cache *cache) {
+    state->keymap_home_row_invalid = !cache->home_row_valid;
+    memcpy(
+        state->home_row_buffer, cache->home_row_buffer, HOME_ROW_BUFFER_LEN
+    );
+    for (int i = 0; i < HOME_ROW_LEN_WITH_BTN; i++) {
+        state->keymap_home_row[i] =
+            state->home_row_buffer + cache->home_row_offsets[i];
+    }
+}
+
+static void save_keymap_cache(
+    struct state *state, struct xkb_keymap *keymap, uint64_t hash, size_t size
+) {
+    struct keymap_cache *cache = calloc(1, sizeof(*cache));
+    cache->hash                = hash;
+    cache->size                = size;
+    cache->home_row_valid      = !state->keymap_home_row_invalid;
+    if (cache->home_row_valid) {
+        memcpy(
+            cache->home_row_buffer, state->home_row_buffer,
+            HOME_ROW_BUFFER_LEN
+        );
+        for (int i = 0; i < HOME_ROW_LEN_WITH_BTN; i++) {
+            cache->home_row_offsets[i] =
+                state->keymap_home_row[i] - state->home_row_buffer;
+        }
+    }
+
+    keymap_cache_fill(cache, keymap);
+    keymap_cache_save(cache);
+    free(cache);
+}
+
+/**
+ * `compile_cached_keymap` compiles the keymap that was kept as text because it
+ * was cached. Returns false if there is none or it is invalid.
+ */
+static bool compile_cached_keymap(struct seat *seat) {
+    if (seat->keymap_text == NULL) {
+        return false;
+    }
+
+    TRACE_BEGIN(keymap_start);
+    seat->xkb_keymap = xkb_keymap_new_from_buffer(
+        seat->xkb_context, seat->keymap_text, seat->keymap_size,
+        XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS
+    );
+
+    free(seat->keymap_text);
+    free(seat->keymap_cache);
+    seat->keymap_text  = NULL;
+    seat->keymap_cache = NULL;
+
+    if (seat->xkb_keymap == NULL) {
+        LOG_ERR("Could not compile keymap.");
+        TRACE_END("keymap_compile", keymap_start);
+        return false;
+    }
+
+    seat->xkb_state = xkb_state_new(seat->xkb_keymap);
+    xkb_state_update_mask(
+        seat->xkb_state, seat->mods_depressed, seat->mods_latched,
+        seat->mods_locked, 0, 0, seat->group
+    );
+    TRACE_END("keymap_compile", keymap_start);
+    return true;
 }
 
 static void handle_keyboard_keymap(
@@ -226,6 +1196,8 @@ static void handle_keyboard_keymap(
     uint32_t size
 ) {
     struct seat *seat = data;
+    TRACE_BEGIN(keymap_start);
+
     if (seat->xkb_state != NULL) {
         xkb_state_unref(seat->xkb_state);
         seat->xkb_state = NULL;
@@ -234,7 +1206,12 @@ static void handle_keyboard_keymap(
         xkb_keymap_unref(seat->xkb_keymap);
         seat->xkb_keymap = NULL;
     }
+    free(seat->keymap_text);
+    free(seat->keymap_cache);
+    seat->keymap_text  = NULL;
+    seat->keymap_cache = NULL;
 
+    uint64_t hash = 0;
     switch (format) {
     case WL_KEYBOARD_KEYMAP_FORMAT_NO_KEYMAP:
         seat->xkb_keymap = xkb_keymap_new_from_names(
@@ -246,8 +1223,29 @@ static void handle_keyboard_keymap(
         void *buffer = mmap(NULL, size - 1, PROT_READ, MAP_PRIVATE, fd, 0);
         if (buffer == MAP_FAILED) {
             LOG_ERR("Could not mmap keymap data.");
+            TRACE_END("keymap_load", keymap_start);
+            return;
+        }
+
+        hash = fnv1a(FNV1A_INIT, buffer, size - 1);
+        struct keymap_cache *cache = malloc(sizeof(*cache));
+        if (keymap_cache_load(cache, hash, size - 1)) {
+            // The keymap is only compiled once a key press can't be
+            // translated with the cached keysyms.
+            seat->keymap_cache = cache;
+            seat->keymap_size  = size - 1;
+            seat->keymap_text  = malloc(size - 1);
+            memcpy(seat->keymap_text, buffer, size - 1);
+
+            munmap(buffer, size - 1);
+            close(fd);
+
+            load_cached_home_row(seat->state, cache);
+            update_home_row_map(seat->state);
+            TRACE_END("keymap_load_cached", keymap_start);
             return;
         }
+        free(cache);
 
         seat->xkb_keymap = xkb_keymap_new_from_buffer(
             seat->xkb_context, buffer, size - 1, XKB_KEYMAP_FORMAT_TEXT_V1,
@@ -259,13 +1257,21 @@ static void handle_keyboard_keymap(
         break;
     }
 
-    if (seat->state->config.general.home_row_keys == NULL) {
-        load_home_row(
-            seat->xkb_keymap, seat->state->home_row,
-            seat->state->home_row_buffer
-        );
-    }
+    // The home row is always resolved as the configured keys may change
+    // between daemon requests.
+    seat->state->keymap_home_row_invalid = !load_home_row(
+        seat->xkb_keymap, seat->state->keymap_home_row,
+        seat->state->home_row_buffer
+    );
+    update_home_row_map(seat->state);
     seat->xkb_state = xkb_state_new(seat->xkb_keymap);
+
+    if (format == WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1 &&
+        seat->xkb_keymap != NULL) {
+        save_keymap_cache(seat->state, seat->xkb_keymap, hash, size - 1);
+    }
+
+    TRACE_END("keymap_load", keymap_start);
 }
 
 static void handle_keyboard_key(
@@ -275,16 +1281,56 @@ static void handle_keyboard_key(
     struct seat        *seat = data;
     char                text[64];
     const xkb_keycode_t key_code = key + 8;
-    const xkb_keysym_t  key_sym =
-        xkb_state_key_get_one_sym(seat->xkb_state, key_code);
+
+    // Without modifiers, or only locked ones that don't affect the key, the
+    // keysym is the cached one of the keycode.
+    xkb_keysym_t key_sym;
+    if (seat->keymap_cache != NULL && key_code < KEYMAP_CACHE_NUM_KEYCODES &&
+        seat->mods_depressed == 0 && seat->mods_latched == 0 &&
+        (seat->mods_locked & seat->keymap_cache->locked_mods[key_code]) == 0 &&
+        seat->group == 0) {
+        key_sym = seat->keymap_cache->keysyms[key_code];
+    } else if (seat->xkb_state != NULL || compile_cached_keymap(seat)) {
+        key_sym = xkb_state_key_get_one_sym(seat->xkb_state, key_code);
+    } else {
+        return;
+    }
     xkb_keysym_to_utf8(key_sym, text, sizeof(text));
 
+    if (seat->state->current_mode == NO_MODE_ENTERED) {
+        // The overlay can get the focus before its first frame, keep the keys
+        // typed until then.
+        struct state *state = seat->state;
+        if (key_state == WL_KEYBOARD_KEY_STATE_PRESSED &&
+            state->num_typeahead < TYPEAHEAD_MAX_KEYS) {
+            struct typeahead_key *k = &state->typeahead[state->num_typeahead++];
+            k->time                 = time;
+            k->keysym               = key_sym;
+            xkb_keysym_to_utf8(key_sym, k->text, sizeof(k->text));
+        }
+        return;
+    }
+
     if (key_state == WL_KEYBOARD_KEY_STATE_PRESSED) {
-        bool redraw = mode_handle_key(seat->state, key_sym, text);
-        if (has_last_mode_returned(seat->state)) {
-            seat->state->running = false;
+        struct state *state = seat->state;
+        int           mode  = state->current_mode;
+
+        struct damage damage;
+        damage_clear(&damage);
+        mode_damage(state, &damage);
+
+        bool redraw = mode_handle_key(state, key_sym, text);
+        if (has_last_mode_returned(state)) {
+            state->running = false;
         } else if (redraw) {
-            request_frame(seat->state);
+            if (state->current_mode == mode) {
+                mode_damage(state, &damage);
+            } else {
+                damage_set_full(&damage);
+            }
+
+            add_damage(state, &damage);
+            request_frame(state);
         }
     }
 }
@@ -294,10 +1340,19 @@ static void handle_keyboard_modifiers(
     uint32_t mods_depressed, uint32_t mods_latched, uint32_t mods_locked,
     uint32_t group
 ) {
-    struct seat *seat = data;
-    xkb_state_update_mask(
-        seat->xkb_state, mods_depressed, mods_latched, mods_locked, 0, 0, group
-    );
+    struct seat *seat    = data;
+    seat->mods_depressed = mods_depressed;
+    seat->mods_latched   = mods_latched;
+    seat->mods_locked    = mods_locked;
+    seat->group          = group;
+
+    // Until the keymap is compiled, they are applied when it is.
+    if (seat->xkb_state != NULL) {
+        xkb_state_update_mask(
+            seat->xkb_state, mods_depressed, mods_latched, mods_locked, 0, 0,
+            group
+        );
+    }
 }
 
 static const struct wl_keyboard_listener wl_keyboard_listener = {
@@ -340,6 +1395,8 @@ static void free_seats(struct wl_list *seats) {
         if (seat->xkb_keymap != NULL) {
             xkb_keymap_unref(seat->xkb_keymap);
         }
+        free(seat->keymap_text);
+        free(seat->keymap_cache);
         xkb_context_unref(seat->xkb_context);
 
         wl_seat_destroy(seat->wl_seat);
@@ -348,15 +1405,21 @@ static void free_seats(struct wl_list *seats) {
     }
 }
 
+static void free_output(struct output *output) {
+    wl_output_destroy(output->wl_output);
+    if (output->xdg_output != NULL) {
+        zxdg_output_v1_destroy(output->xdg_output);
+    }
+    wl_list_remove(&output->link);
+    free(output->name);
+    free(output);
+}
+
 static void free_outputs(struct wl_list *outputs) {
     struct output *output;
     struct output *tmp;
     wl_list_for_each_safe (output, tmp, outputs, link) {
-        wl_output_destroy(output->wl_output);
-        zxdg_output_v1_destroy(output->xdg_output);
-        wl_list_remove(&output->link);
-        free(output->name);
-        free(output);
+        free_output(output);
     }
 }
 
@@ -429,8 +1492,17 @@ const static struct zxdg_output_v1_listener xdg_output_listener = {
 };
 
 static void load_xdg_outputs(struct state *state) {
+    TRACE_BEGIN(start);
+
+    bool           loaded = false;
     struct output *output;
     wl_list_for_each (output, &state->outputs, link) {
+        // Outputs may have been added since the last call in daemon mode.
+        if (output->xdg_output != NULL) {
+            continue;
+        }
+
+        loaded             = true;
         output->xdg_output = zxdg_output_manager_v1_get_xdg_output(
             state->xdg_output_manager, output->wl_output
         );
@@ -439,7 +1511,36 @@ static void load_xdg_outputs(struct state *state) {
         );
     }
 
-    wl_display_roundtrip(state->wl_display);
+    if (loaded) {
+        wl_display_roundtrip(state->wl_display);
+    }
+
+    TRACE_END("load_xdg_outputs", start);
+}
+
+/**
+ * `replay_typeahead` handles the keys typed before the first mode was entered.
+ * The first frame is rendered after them so only their final state is shown.
+ */
+static void replay_typeahead(struct state *state) {
+    if (state->num_typeahead > 0) {
+        uint32_t first = state->typeahead[0].time;
+        uint32_t last  = state->typeahead[state->num_typeahead - 1].time;
+        LOG_DEBUG(
+            "Replaying %d keys typed over %u ms.", state->num_typeahead,
+            last - first
+        );
+    }
+
+    for (int i = 0; i < state->num_typeahead && state->running; i++) {
+        struct typeahead_key *k = &state->typeahead[i];
+        mode_handle_key(state, k->keysym, k->text);
+        if (has_last_mode_returned(state)) {
+            state->running = false;
+        }
+    }
+
+    state->num_typeahead = 0;
 }
 
 static void enter_first_mode(struct state *state) {
@@ -455,6 +1556,8 @@ static void enter_first_mode(struct state *state) {
         }
     }
 
+    TRACE_BEGIN(start);
+
     if (!compute_initial_area(state, &state->initial_area)) {
         state->running = false;
         return;
@@ -475,12 +1578,16 @@ static void enter_first_mode(struct state *state) {
     }
 
     enter_next_mode(state, state->initial_area);
+    replay_typeahead(state);
 
     if (state->running) {
         wl_list_for_each (overlay, &state->overlay_surfaces, link) {
-            send_frame_for_overlay(overlay);
+            overlay->frame_due = true;
         }
+        send_due_frames(state);
     }
+
+    TRACE_END("enter_first_mode", start);
 }
 
 static void handle_surface_enter(
@@ -489,6 +1596,8 @@ static void handle_surface_enter(
     struct overlay_surface *overlay = data;
     struct state           *state   = overlay->state;
 
+    trace_instant("surface_enter");
+
     // Only update output if not already known (single-output, no -O/-r flag).
     if (overlay->output == NULL) {
         overlay->output =
@@ -518,6 +1627,10 @@ static void handle_registry_global(
         state->wl_compositor =
             wl_registry_bind(registry, name, &wl_compositor_interface, 4);
 
+    } else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+        state->wl_subcompositor =
+            wl_registry_bind(registry, name, &wl_subcompositor_interface, 1);
+
     } else if (strcmp(interface, wl_shm_interface.name) == 0) {
         state->wl_shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
 
@@ -542,6 +1655,7 @@ static void handle_registry_global(
             wl_registry_bind(registry, name, &wl_output_interface, 3);
         struct output *output = calloc(1, sizeof(struct output));
         output->wl_output     = wl_output;
+        output->global_name   = name;
         output->scale         = 1;
 
         wl_output_add_listener(output->wl_output, &output_listener, output);
@@ -567,6 +1681,12 @@ static void handle_registry_global(
         state->fractional_scale_mgr = wl_registry_bind(
             registry, name, &wp_fractional_scale_manager_v1_interface, 1
         );
+    } else if (strcmp(
+                   interface, wp_single_pixel_buffer_manager_v1_interface.name
+               ) == 0) {
+        state->single_pixel_buffer_mgr = wl_registry_bind(
+            registry, name, &wp_single_pixel_buffer_manager_v1_interface, 1
+        );
 #if OPENCV_ENABLED
     } else if (strcmp(interface, zwlr_screencopy_manager_v1_interface.name) ==
                0) {
@@ -577,9 +1697,38 @@ static void handle_registry_global(
     }
 }
 
+static void handle_registry_global_remove(
+    void *data, struct wl_registry *registry, uint32_t name
+) {
+    struct state  *state = data;
+    struct output *output;
+    wl_list_for_each (output, &state->outputs, link) {
+        if (output->global_name != name) {
+            continue;
+        }
+
+        // Cancel the selection if the output it is shown on goes away.
+        struct overlay_surface *overlay;
+        wl_list_for_each (overlay, &state->overlay_surfaces, link) {
+            if (overlay->output == output) {
+                overlay->output = NULL;
+                state->running  = false;
+            }
+        }
+
+        if (state->current_output == output) {
+            state->current_output = NULL;
+            state->running        = false;
+        }
+
+        free_output(output);
+        return;
+    }
+}
+
 const struct wl_registry_listener wl_registry_listener = {
     .global        = handle_registry_global,
-    .global_remove = noop,
+    .global_remove = handle_registry_global_remove,
 };
 
 static void handle_layer_surface_configure(
@@ -589,6 +1738,8 @@ static void handle_layer_surface_configure(
     struct overlay_surface *overlay = data;
     struct state           *state   = overlay->state;
 
+    trace_instant("layer_surface_configure");
+
     overlay->width  = width;
     overlay->height = height;
     zwlr_layer_surface_v1_ack_configure(layer_surface, serial);
@@ -596,11 +1747,16 @@ static void handle_layer_surface_configure(
     bool was_configured = overlay->configured;
     overlay->configured = true;
 
+    // Committed with the next frame.
+    attach_overlay_buffer(overlay);
+
     if (overlay->output != NULL) {
         enter_first_mode(state);
     } else if (!was_configured) {
-        // Output not yet known; send a transparent frame to get surface.enter.
-        send_transparent_frame_to_overlay(overlay);
+        // Output not yet known; map the transparent surface to get
+        // surface.enter.
+        trace_instant("wl_surface_commit");
+        wl_surface_commit(overlay->wl_surface);
     }
 }
 
@@ -624,6 +1780,9 @@ static void fractional_scale_preferred(
     overlay->fractional_scale_val     = scale;
 
     if (old_scale != 0 && old_scale != scale) {
+        struct damage damage;
+        damage_set_full(&damage);
+        add_damage(overlay->state, &damage);
         request_frame(overlay->state);
     }
 }
@@ -657,7 +1816,7 @@ static struct output *find_output_by_name(struct state *state, char *name) {
     return NULL;
 }
 
-static void print_result(struct state *state) {
+static void print_result(struct state *state, FILE *out) {
     char click;
     switch (state->click) {
     case CLICK_LEFT_BTN:
@@ -673,8 +1832,8 @@ static void print_result(struct state *state) {
         click = 'n';
     }
 
-    printf(
-        "%dx%d+%d+%d +%d+%d %c\n", state->result.w, state->result.h,
+    fprintf(
+        out, "%dx%d+%d+%d +%d+%d %c\n", state->result.w, state->result.h,
         state->result.x, state->result.y, state->current_output->x,
         state->current_output->y, click
     );
@@ -751,6 +1910,9 @@ static void print_usage() {
     puts(" -O, --output        specify display output to use");
     puts(" -A, --all-outputs   show overlay on all outputs simultaneously");
     puts(" -p, --only-print    only print, don't move the cursor or click");
+    puts(" --daemon            stay resident and serve `--client` requests");
+    puts(" --client            run the selection in a running daemon");
+    puts(" --trace=FILE        write a trace of the startup and frame phases");
 }
 
 static void print_version() {
@@ -766,6 +1928,27 @@ static void print_version() {
  * If `output` is NULL the compositor will choose (single-output, no -O flag).
  * `keyboard` controls whether this surface gets exclusive keyboard focus.
  */
+static void init_overlay_part(
+    struct overlay_surface *overlay, struct overlay_part *part,
+    struct wl_region *input_region
+) {
+    struct state *state = overlay->state;
+
+    part->wl_surface    = wl_compositor_create_surface(state->wl_compositor);
+    part->wl_subsurface = wl_subcompositor_get_subsurface(
+        state->wl_subcompositor, part->wl_surface, overlay->wl_surface
+    );
+    part->wp_viewport =
+        wp_viewporter_get_viewport(state->wp_viewporter, part->wl_surface);
+    wl_surface_set_input_region(part->wl_surface, input_region);
+}
+
+static void free_overlay_part(struct overlay_part *part) {
+    wp_viewport_destroy(part->wp_viewport);
+    wl_subsurface_destroy(part->wl_subsurface);
+    wl_surface_destroy(part->wl_surface);
+}
+
 static struct overlay_surface *create_overlay_surface(
     struct state *state, struct output *output, bool keyboard
 ) {
@@ -773,7 +1956,17 @@ static struct overlay_surface *create_overlay_surface(
     overlay->state                  = state;
     overlay->output                 = output;
 
-    surface_buffer_pool_init(&overlay->surface_buffer_pool);
+    surface_buffer_pool_init(
+        &overlay->surface_buffer_pool, state->config.general.buffer_count,
+        state->config.general.prefault_shm, handle_buffer_released, overlay
+    );
+    surface_buffer_pool_init(
+        &overlay->speculation_pool, state->config.general.speculative_frames,
+        state->config.general.prefault_shm, handle_buffer_released, overlay
+    );
+    overlay->next_candidate   = -1;
+    overlay->speculation.slot = -1;
+    overlay->buffer_area_mode = NO_MODE_ENTERED;
 
     overlay->wl_surface = wl_compositor_create_surface(state->wl_compositor);
     wl_surface_add_listener(overlay->wl_surface, &surface_listener, overlay);
@@ -787,11 +1980,43 @@ static struct overlay_surface *create_overlay_surface(
         overlay->wl_layer_surface, &wl_layer_surface_listener, overlay
     );
     zwlr_layer_surface_v1_set_exclusive_zone(overlay->wl_layer_surface, -1);
-    zwlr_layer_surface_v1_set_anchor(
-        overlay->wl_layer_surface,
-        ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT |
-            ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM
-    );
+
+    // With a restricted area, the surface only covers it.
+    struct rect area = {-1, -1, -1, -1};
+    if (!state->config.general.all_outputs && output != NULL &&
+        state->initial_area.w != -1) {
+        area = rect_intersection(
+            state->initial_area,
+            (struct rect){0, 0, output->width, output->height}
+        );
+    }
+
+    if (area.w > 0 && area.h > 0) {
+        overlay->x = area.x;
+        overlay->y = area.y;
+        zwlr_layer_surface_v1_set_anchor(
+            overlay->wl_layer_surface,
+            ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP
+        );
+        zwlr_layer_surface_v1_set_size(
+            overlay->wl_layer_surface, area.w, area.h
+        );
+        zwlr_layer_surface_v1_set_margin(
+            overlay->wl_layer_surface, area.y, 0, 0, area.x
+        );
+    } else {
+        if (state->config.general.all_outputs && output != NULL) {
+            overlay->x = output->x;
+            overlay->y = output->y;
+        }
+        zwlr_layer_surface_v1_set_anchor(
+            overlay->wl_layer_surface,
+            ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+                ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT |
+                ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+                ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM
+        );
+    }
     zwlr_layer_surface_v1_set_keyboard_interactivity(
         overlay->wl_layer_surface, keyboard
     );
@@ -814,8 +2039,19 @@ static struct overlay_surface *create_overlay_surface(
         wl_compositor_create_region(state->wl_compositor);
     wl_region_add(region, 0, 0, 0, 0);
     wl_surface_set_input_region(overlay->wl_surface, region);
+
+    // Subsurfaces are stacked in creation order, the content on top.
+    for (int i = 0; i < OVERLAY_NUM_BACKGROUND_PARTS; i++) {
+        init_overlay_part(overlay, &overlay->background[i], region);
+    }
+    init_overlay_part(overlay, &overlay->content, region);
+
     wl_region_destroy(region);
 
+    solid_buffer_cache_init(
+        &overlay->solid_buffers, state->single_pixel_buffer_mgr, state->wl_shm
+    );
+
     wl_surface_commit(overlay->wl_surface);
 
     return overlay;
@@ -825,10 +2061,16 @@ static void free_overlay_surface(struct overlay_surface *overlay) {
     if (overlay->fractional_scale) {
         wp_fractional_scale_v1_destroy(overlay->fractional_scale);
     }
+    free_overlay_part(&overlay->content);
+    for (int i = 0; i < OVERLAY_NUM_BACKGROUND_PARTS; i++) {
+        free_overlay_part(&overlay->background[i]);
+    }
     wp_viewport_destroy(overlay->wp_viewport);
     zwlr_layer_surface_v1_destroy(overlay->wl_layer_surface);
     wl_surface_destroy(overlay->wl_surface);
     surface_buffer_pool_destroy(&overlay->surface_buffer_pool);
+    surface_buffer_pool_destroy(&overlay->speculation_pool);
+    solid_buffer_cache_finish(&overlay->solid_buffers);
     wl_list_remove(&overlay->link);
     free(overlay);
 }
@@ -841,157 +2083,611 @@ static void free_overlay_surfaces(struct wl_list *overlay_surfaces) {
     }
 }
 
-int main(int argc, char **argv) {
-    struct state state = {
-        .wl_display           = NULL,
-        .wl_registry          = NULL,
-        .wl_compositor        = NULL,
-        .wl_shm               = NULL,
-        .wl_layer_shell       = NULL,
-#if OPENCV_ENABLED
-        .wl_screencopy_manager = NULL,
-#endif
-        .wp_viewporter        = NULL,
-        .fractional_scale_mgr = NULL,
-        .running              = true,
-        .result               = (struct rect){-1, -1, -1, -1},
-        .initial_area         = (struct rect){-1, -1, -1, -1},
-        .home_row = (char *[]){"", "", "", "", "", "", "", "", "", "", ""},
-        .click    = CLICK_NONE,
-    };
+/**
+ * Options given on the command line. In daemon mode, each client request comes
+ * with its own.
+ */
+struct cli_options {
+    char       *config_filename;
+    char       *selected_output_name;
+    char      **cli_configs;
+    int         num_cli_configs;
+    struct rect initial_area;
+    bool        all_outputs;
+    bool        only_print;
+    bool        daemon;
+    char       *trace_filename;
+};
+
+enum parse_cli_options_ret {
+    CLI_OPTIONS_OK = 0,
+    CLI_OPTIONS_EXIT,
+    CLI_OPTIONS_ERR,
+};
+
+static void free_cli_options(struct cli_options *options) {
+    free(options->config_filename);
+    free(options->selected_output_name);
+    free(options->cli_configs);
+    free(options->trace_filename);
+    memset(options, 0, sizeof(*options));
+}
+
+#define SHORT_OPTIONS "hvr:o:c:O:ARp"
+
+static struct option long_options[] = {
+    {"help", no_argument, 0, 'h'},
+    {"help-config", no_argument, 0, 'H'},
+    {"version", no_argument, 0, 'v'},
+    {"restrict", required_argument, 0, 'r'},
+    {"config", required_argument, 0, 'c'},
+    {"output", required_argument, 0, 'O'},
+    {"all-outputs", no_argument, 0, 'A'},
+    {"only-print", no_argument, 0, 'p'},
+    {"daemon", no_argument, 0, 'D'},
+    {"client", no_argument, 0, 'C'},
+    {"trace", required_argument, 0, 'T'},
+    {NULL, 0, NULL, 0}
+};
+
+/**
+ * `find_client_option` returns the index of `--client` in `argv` or -1 if it
+ * isn't passed. An option's value spelled `--client` doesn't count.
+ */
+static int find_client_option(int argc, char **argv) {
+    // The command line isn't reordered so that the index stays valid.
+    int option_char;
+    int client_i = -1;
+    opterr       = 0;
+    optind       = 0;
+    while ((option_char = getopt_long(
+                argc, argv, "+" SHORT_OPTIONS, long_options, NULL
+            )) != -1) {
+        if (option_char == 'C') {
+            client_i = optind - 1;
+            break;
+        }
+    }
+    opterr = 1;
+
+    return client_i;
+}
+
+/**
+ * `parse_cli_options` parses the command line arguments into `options`. When
+ * `remote` is set, i.e. when parsing a client's request in daemon mode, the
+ * options that only concern the local process are rejected.
+ */
+static enum parse_cli_options_ret parse_cli_options(
+    int argc, char **argv, struct cli_options *options, bool remote
+) {
+    memset(options, 0, sizeof(*options));
+    options->initial_area = (struct rect){-1, -1, -1, -1};
+    options->cli_configs  = malloc(10 * sizeof(char *));
 
-    config_set_default(&state.config);
-    struct config_loader config_loader;
-    config_loader_init(&config_loader, &state.config);
-
-    static struct option long_options[] = {
-        {"help", no_argument, 0, 'h'},
-        {"help-config", no_argument, 0, 'H'},
-        {"version", no_argument, 0, 'v'},
-        {"restrict", required_argument, 0, 'r'},
-        {"config", required_argument, 0, 'c'},
-        {"output", required_argument, 0, 'O'},
-        {"all-outputs", no_argument, 0, 'A'},
-        {"only-print", no_argument, 0, 'p'},
-        {NULL, 0, NULL, 0}
-    };
+    int cli_configs_len = 10;
+    int option_char     = 0;
+    int option_index    = 0;
+
+    // `getopt` keeps its position between calls. It needs to be reset as the
+    // daemon parses a new command line for each request.
+    optind = 0;
 
-    int    num_cli_configs      = 0;
-    char **cli_configs          = malloc(10 * sizeof(char*));
-    int    cli_configs_len      = 10;
-    int    option_char          = 0;
-    int    option_index         = 0;
-    char  *config_filename      = NULL;
-    char  *selected_output_name = NULL;
-    bool   only_print           = false;
     while ((option_char = getopt_long(
-                argc, argv, "hvr:o:c:O:ARp", long_options, &option_index
+                argc, argv, SHORT_OPTIONS, long_options, &option_index
             )) != -1) {
         switch (option_char) {
         case 'h':
+            if (remote) {
+                goto local_only;
+            }
             print_usage();
-            config_free_values(&state.config);
-            return 0;
+            return CLI_OPTIONS_EXIT;
 
         case 'v':
+            if (remote) {
+                goto local_only;
+            }
             print_version();
-            config_free_values(&state.config);
-            return 0;
+            return CLI_OPTIONS_EXIT;
 
         case 'r':
             if (sscanf(
-                    optarg, "%dx%d+%d+%d", &state.initial_area.w,
-                    &state.initial_area.h, &state.initial_area.x,
-                    &state.initial_area.y
+                    optarg, "%dx%d+%d+%d", &options->initial_area.w,
+                    &options->initial_area.h, &options->initial_area.x,
+                    &options->initial_area.y
                 ) != 4) {
                 LOG_ERR("Could not parse --restrict argument.");
-                return 1;
+                return CLI_OPTIONS_ERR;
             }
             break;
 
         case 'o':
-            if (num_cli_configs >= cli_configs_len) {
+            if (options->num_cli_configs >= cli_configs_len) {
                 cli_configs_len += 10;
-                cli_configs =
-                    realloc(cli_configs, cli_configs_len * sizeof(char*));
+                options->cli_configs = realloc(
+                    options->cli_configs, cli_configs_len * sizeof(char *)
+                );
             }
-            cli_configs[num_cli_configs++] = optarg;
+            options->cli_configs[options->num_cli_configs++] = optarg;
             break;
 
         case 'c':
-            config_filename = strdup(optarg);
+            free(options->config_filename);
+            options->config_filename = strdup(optarg);
             break;
 
         case 'H':
+            if (remote) {
+                goto local_only;
+            }
             print_default_config();
-            config_free_values(&state.config);
-            return 0;
+            return CLI_OPTIONS_EXIT;
 
         case 'O':
-            selected_output_name = strdup(optarg);
+            free(options->selected_output_name);
+            options->selected_output_name = strdup(optarg);
             break;
 
         case 'A':
-            state.config.general.all_outputs = true;
+            options->all_outputs = true;
             break;
 
         case 'p':
-            only_print = true;
+            options->only_print = true;
+            break;
+
+        case 'D':
+            if (remote) {
+                goto local_only;
+            }
+            options->daemon = true;
+            break;
+
+        case 'C':
+            // Handled before parsing the command line.
+            break;
+
+        case 'T':
+            if (remote) {
+                goto local_only;
+            }
+            free(options->trace_filename);
+            options->trace_filename = strdup(optarg);
             break;
 
         default:
             LOG_ERR("Unknown argument.");
-            config_free_values(&state.config);
-            return 1;
+            return CLI_OPTIONS_ERR;
         }
     }
 
-    int err = config_loader_load_file(&config_loader, config_filename);
+    return CLI_OPTIONS_OK;
+
+local_only:
+    LOG_ERR("Option not supported with --client.");
+    return CLI_OPTIONS_ERR;
+}
+
+/**
+ * `load_session_config` loads the configuration for a selection from the
+ * defaults, the configuration file and the command line options.
+ */
+static int
+load_session_config(struct state *state, struct cli_options *options) {
+    config_set_default(&state->config);
+    if (options->all_outputs) {
+        state->config.general.all_outputs = true;
+    }
+
+    struct config_loader config_loader;
+    config_loader_init(&config_loader, &state->config);
+
+    int err = config_loader_load_file(&config_loader, options->config_filename);
     if (err) {
         LOG_ERR("Failed to read configuration file.");
         return 1;
     }
-    if (config_filename != NULL) {
-        free(config_filename);
-        config_filename = NULL;
-    }
 
-    for (int i = 0; i < num_cli_configs; i++) {
-        if (config_loader_load_cli_param(&config_loader, cli_configs[i])) {
+    for (int i = 0; i < options->num_cli_configs; i++) {
+        if (config_loader_load_cli_param(
+                &config_loader, options->cli_configs[i]
+            )) {
             return 1;
         }
     }
-    free(cli_configs);
-    cli_configs = NULL;
 
-    if (state.config.general.all_outputs && selected_output_name != NULL) {
+    if (state->config.general.all_outputs &&
+        options->selected_output_name != NULL) {
         LOG_ERR("--all-outputs and --output are mutually exclusive.");
         return 1;
     }
 
-    if (state.config.general.all_outputs && state.initial_area.w != -1) {
+    if (state->config.general.all_outputs && options->initial_area.w != -1) {
         LOG_ERR("--all-outputs and --restrict are mutually exclusive.");
         return 1;
     }
 
-    if (state.config.general.home_row_keys != NULL) {
-        state.home_row = state.config.general.home_row_keys;
+    return 0;
+}
+
+/**
+ * `run_session` shows the overlay and runs a whole selection with the already
+ * loaded configuration. The result is printed to `out`. Returns the process'
+ * status code.
+ */
+static int
+run_session(struct state *state, struct cli_options *options, FILE *out) {
+    state->running        = true;
+    state->result         = (struct rect){-1, -1, -1, -1};
+    state->initial_area   = options->initial_area;
+    state->click          = CLICK_NONE;
+    state->current_output = NULL;
+    state->num_typeahead  = 0;
+
+    if (state->config.general.home_row_keys != NULL) {
+        state->home_row = state->config.general.home_row_keys;
+    } else if (state->keymap_home_row_invalid) {
+        LOG_ERR("Could not load home row keys from keymap.");
+        return 1;
+    } else {
+        state->home_row = state->keymap_home_row;
     }
+    keysym_map_init_strs(
+        &state->home_row_map, state->home_row, HOME_ROW_LEN_WITH_BTN
+    );
 
-    if (load_modes(&state, state.config.general.modes) != 0) {
+    if (load_modes(state, state->config.general.modes) != 0) {
         LOG_ERR("Could not load modes.");
         return 1;
     }
 
+    if (state->wl_virtual_pointer_mgr == NULL && !options->only_print) {
+        LOG_ERR("Failed to get wlr_virtual_pointer_manager_v1 object.");
+        return 1;
+    }
+
+    load_xdg_outputs(state);
+
+    if (state->config.general.all_outputs) {
+        // Create one overlay surface per output. Only the first gets keyboard
+        // interactivity; the compositor routes all keys there via exclusive grab.
+        bool           first = true;
+        struct output *output;
+        wl_list_for_each (output, &state->outputs, link) {
+            struct overlay_surface *overlay =
+                create_overlay_surface(state, output, first);
+            wl_list_insert(state->overlay_surfaces.prev, &overlay->link);
+            first = false;
+        }
+    } else {
+        // Single-output mode: resolve the target output from -O / -r flags.
+        if (options->selected_output_name) {
+            state->current_output =
+                find_output_by_name(state, options->selected_output_name);
+            if (!state->current_output) {
+                LOG_ERR(
+                    "Could not find output '%s'.", options->selected_output_name
+                );
+                return 1;
+            }
+        } else if (state->initial_area.w != -1) {
+            state->current_output =
+                find_output_from_rect(state, &state->initial_area);
+            if (!state->current_output) {
+                LOG_ERR("Could not find output containing given area.");
+                return 1;
+            }
+            state->initial_area.x -= state->current_output->x;
+            state->initial_area.y -= state->current_output->y;
+        }
+
+        struct overlay_surface *overlay =
+            create_overlay_surface(state, state->current_output, true);
+        wl_list_insert(&state->overlay_surfaces, &overlay->link);
+    }
+
+    // Regular files can't be watched but they are read quickly anyway.
+    input_buffer_init(&state->input_buffer);
+    if (reads_input(state)) {
+        event_loop_add_fd(
+            &state->event_loop, fileno(state->input), read_input, state
+        );
+    }
+
+    // The main thread renders too.
+    render_pool_init(&state->render_pool, sysconf(_SC_NPROCESSORS_ONLN) - 1);
+
+    while (state->running) {
+        // Frames are rendered ahead when there are no events to handle.
+        struct overlay_surface *overlay = next_speculating_overlay(state);
+        if (overlay == NULL) {
+            event_loop_set_timer(
+                &state->event_loop, release_idle_buffers(state)
+            );
+        }
+
+        int timeout = overlay != NULL ? 0 : -1;
+        int ret     = event_loop_dispatch(&state->event_loop, timeout);
+        if (ret < 0) {
+            break;
+        }
+
+        if (state->event_loop.terminated) {
+            state->running = false;
+        }
+
+        // The frames of the overlays whose callbacks were done together are
+        // rendered together.
+        send_due_frames(state);
+
+        if (ret == 0 && (overlay = next_speculating_overlay(state)) != NULL) {
+            speculate_overlay(overlay);
+        }
+    }
+
+    render_pool_finish(&state->render_pool);
+
+    event_loop_remove_fd(&state->event_loop, fileno(state->input));
+    input_buffer_finish(&state->input_buffer);
+
+    wl_display_roundtrip(state->wl_display);
+
+    free_overlay_surfaces(&state->overlay_surfaces);
+
+    wl_display_roundtrip(state->wl_display);
+
+    int status_code = 0;
+    if (state->result.x != -1 && state->current_output != NULL) {
+        resolve_result_output(state);
+        print_result(state, out);
+        if (!options->only_print) {
+            TRACE_BEGIN(move_pointer_start);
+            move_pointer(
+                state, state->result.x + state->result.w / 2,
+                state->result.y + state->result.h / 2, state->click
+            );
+            TRACE_END("move_pointer", move_pointer_start);
+        }
+    } else {
+        status_code = state->config.general.cancellation_status_code;
+    }
+
+    free_mode_states(state);
+    state->current_mode = NO_MODE_ENTERED;
+
+    return status_code;
+}
+
+/**
+ * `warm_up_font_cache` loads the label fonts once so that fontconfig is
+ * initialised before the daemon's first request.
+ */
+static void warm_up_font_cache(struct config *config) {
+    char *font_families[] = {
+        config->mode_tile.label_font_family,
+        config->mode_floating.label_font_family,
+        config->mode_bisect.label_font_family,
+    };
+
+    cairo_surface_t *surface =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+    cairo_t *cairo = cairo_create(surface);
+
+    for (int i = 0; i < sizeof(font_families) / sizeof(font_families[0]);
+         i++) {
+        // The builtin font doesn't need fontconfig.
+        if (strcmp(font_families[i], BUILTIN_FONT_FAMILY) == 0) {
+            continue;
+        }
+
+        cairo_font_face_t *font_face = cairo_toy_font_face_create(
+            font_families[i], CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL
+        );
+        cairo_set_font_face(cairo, font_face);
+
+        cairo_text_extents_t te;
+        cairo_text_extents(cairo, "a", &te);
+        cairo_font_face_destroy(font_face);
+    }
+
+    cairo_destroy(cairo);
+    cairo_surface_destroy(surface);
+}
+
+/**
+ * `resolve_client_path` makes a path relative to the client's working
+ * directory absolute, as the daemon's own may differ.
+ */
+static void resolve_client_path(char **path, const char *cwd) {
+    if (*path == NULL || (*path)[0] == '/' || cwd[0] == '\0') {
+        return;
+    }
+
+    char *resolved;
+    if (asprintf(&resolved, "%s/%s", cwd, *path) < 0) {
+        return;
+    }
+
+    free(*path);
+    *path = resolved;
+}
+
+static void serve_daemon_request(struct state *state, int listen_fd) {
+    struct daemon_request request;
+    if (daemon_accept(listen_fd, &request)) {
+        return;
+    }
+
+    char  *output     = NULL;
+    size_t output_len = 0;
+    FILE  *out        = open_memstream(&output, &output_len);
+
+    int                status_code = 1;
+    struct cli_options options;
+    if (parse_cli_options(request.argc, request.argv, &options, true) ==
+        CLI_OPTIONS_OK) {
+        resolve_client_path(&options.config_filename, request.cwd);
+        config_free_values(&state->config);
+
+        if (load_session_config(state, &options) == 0) {
+            if (request.input_fd >= 0) {
+                FILE *input = fdopen(request.input_fd, "r");
+                if (input != NULL) {
+                    state->input     = input;
+                    request.input_fd = -1;
+                }
+            }
+
+            status_code = run_session(state, &options, out);
+
+            if (state->input != stdin) {
+                fclose(state->input);
+                state->input = stdin;
+            }
+        }
+    }
+
+    free_cli_options(&options);
+    fclose(out);
+
+    daemon_respond(&request, status_code, output);
+    daemon_request_free(&request);
+    free(output);
+
+    // The daemon doesn't exit so the trace is written after each request.
+    trace_write();
+}
+
+static void set_has_request(void *data, int fd, uint32_t events) {
+    bool *has_request = data;
+    *has_request      = true;
+}
+
+/**
+ * `run_daemon` keeps the Wayland connection, globals, outputs and keymap
+ * loaded and serves `--client` requests until the connection is lost or it is
+ * terminated.
+ */
+static int run_daemon(struct state *state) {
+    char path[PATH_MAX];
+    if (daemon_socket_path(path, sizeof(path))) {
+        return 1;
+    }
+
+    int listen_fd = daemon_listen(path);
+    if (listen_fd < 0) {
+        return 1;
+    }
+
+    LOG_INFO("Listening on '%s'.", path);
+
+    // Use the default configuration's fonts to initialise fontconfig.
+    struct cli_options default_options = {
+        .initial_area = {-1, -1, -1, -1},
+    };
+    if (load_session_config(state, &default_options) == 0) {
+        warm_up_font_cache(&state->config);
+    }
+
+    bool has_request = false;
+    if (event_loop_add_fd(
+            &state->event_loop, listen_fd, set_has_request, &has_request
+        )) {
+        LOG_ERR("Could not watch daemon socket.");
+        close(listen_fd);
+        unlink(path);
+        return 1;
+    }
+
+    int status_code = 0;
+    while (!state->event_loop.terminated) {
+        if (event_loop_dispatch(&state->event_loop, -1) < 0) {
+            LOG_ERR("Lost connection to Wayland compositor.");
+            status_code = 1;
+            break;
+        }
+
+        // Sessions are run outside of the dispatch as they dispatch too.
+        if (has_request) {
+            has_request = false;
+            serve_daemon_request(state, listen_fd);
+        }
+    }
+
+    event_loop_remove_fd(&state->event_loop, listen_fd);
+    close(listen_fd);
+    unlink(path);
+
+    return status_code;
+}
+
+int main(int argc, char **argv) {
+    int client_i = find_client_option(argc, argv);
+    if (client_i >= 0) {
+        return daemon_client_run(argc, argv, client_i);
+    }
+
+    struct state state = {
+        .wl_display           = NULL,
+        .wl_registry          = NULL,
+        .wl_compositor        = NULL,
+        .wl_subcompositor     = NULL,
+        .wl_shm               = NULL,
+        .wl_layer_shell       = NULL,
+#if OPENCV_ENABLED
+        .wl_screencopy_manager = NULL,
+#endif
+        .wp_viewporter        = NULL,
+        .fractional_scale_mgr = NULL,
+        .running              = true,
+        .result               = (struct rect){-1, -1, -1, -1},
+        .initial_area         = (struct rect){-1, -1, -1, -1},
+        .keymap_home_row = {"", "", "", "", "", "", "", "", "", "", ""},
+        .input           = stdin,
+        .click           = CLICK_NONE,
+        .current_mode    = NO_MODE_ENTERED,
+    };
+
+    struct cli_options options;
+    switch (parse_cli_options(argc, argv, &options, false)) {
+    case CLI_OPTIONS_OK:
+        break;
+
+    case CLI_OPTIONS_EXIT:
+        free_cli_options(&options);
+        return 0;
+
+    case CLI_OPTIONS_ERR:
+        free_cli_options(&options);
+        return 1;
+    }
+
+    if (options.trace_filename != NULL) {
+        trace_open(options.trace_filename);
+        trace_instant("start");
+    }
+
+    if (!options.daemon && load_session_config(&state, &options) != 0) {
+        return 1;
+    }
+
     wl_list_init(&state.outputs);
     wl_list_init(&state.seats);
     wl_list_init(&state.overlay_surfaces);
 
+    TRACE_BEGIN(connect_start);
     state.wl_display = wl_display_connect(NULL);
     if (state.wl_display == NULL) {
         LOG_ERR("Failed to connect to Wayland compositor.");
         return 1;
     }
+    TRACE_END("connect", connect_start);
+
+    // `SIGINT` and `SIGTERM` cancel the selection through the event loop.
+    if (event_loop_init(&state.event_loop, state.wl_display) != 0) {
+        return 1;
+    }
 
     state.wl_registry = wl_display_get_registry(state.wl_display);
     if (state.wl_registry == NULL) {
@@ -1000,13 +2696,21 @@ int main(int argc, char **argv) {
     }
 
     wl_registry_add_listener(state.wl_registry, &wl_registry_listener, &state);
+
+    TRACE_BEGIN(registry_start);
     wl_display_roundtrip(state.wl_display);
+    TRACE_END("registry_roundtrip", registry_start);
 
     if (state.wl_compositor == NULL) {
         LOG_ERR("Failed to get wl_compositor object.");
         return 1;
     }
 
+    if (state.wl_subcompositor == NULL) {
+        LOG_ERR("Failed to get wl_subcompositor object.");
+        return 1;
+    }
+
     if (state.wl_shm == NULL) {
         LOG_ERR("Failed to get wl_shm object.");
         return 1;
@@ -1017,11 +2721,6 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    if (state.wl_virtual_pointer_mgr == NULL && !only_print) {
-        LOG_ERR("Failed to get wlr_virtual_pointer_manager_v1 object.");
-        return 1;
-    }
-
     if (state.xdg_output_manager == NULL) {
         LOG_ERR("Failed to get xdg_output_manager object.");
         return 1;
@@ -1036,67 +2735,13 @@ int main(int argc, char **argv) {
 
     // This round trip should load the keymap which is needed to determine the
     // home row keys.
+    TRACE_BEGIN(keymap_start);
     wl_display_roundtrip(state.wl_display);
+    TRACE_END("keymap_roundtrip", keymap_start);
 
-    if (state.config.general.all_outputs) {
-        // Create one overlay surface per output. Only the first gets keyboard
-        // interactivity; the compositor routes all keys there via exclusive grab.
-        bool           first = true;
-        struct output *output;
-        wl_list_for_each (output, &state.outputs, link) {
-            struct overlay_surface *overlay =
-                create_overlay_surface(&state, output, first);
-            wl_list_insert(state.overlay_surfaces.prev, &overlay->link);
-            first = false;
-        }
-    } else {
-        // Single-output mode: resolve the target output from -O / -r flags.
-        if (selected_output_name) {
-            state.current_output =
-                find_output_by_name(&state, selected_output_name);
-            if (!state.current_output) {
-                LOG_ERR("Could not find output '%s'.", selected_output_name);
-                return 1;
-            }
-            free(selected_output_name);
-            selected_output_name = NULL;
-        } else if (state.initial_area.w != -1) {
-            state.current_output =
-                find_output_from_rect(&state, &state.initial_area);
-            if (!state.current_output) {
-                LOG_ERR("Could not find output containing given area.");
-                return 1;
-            }
-            state.initial_area.x -= state.current_output->x;
-            state.initial_area.y -= state.current_output->y;
-        }
-
-        struct overlay_surface *overlay =
-            create_overlay_surface(&state, state.current_output, true);
-        wl_list_insert(&state.overlay_surfaces, &overlay->link);
-    }
-
-    while (state.running && wl_display_dispatch(state.wl_display)) {}
-
-    wl_display_roundtrip(state.wl_display);
-
-    free_overlay_surfaces(&state.overlay_surfaces);
-
-    wl_display_roundtrip(state.wl_display);
-
-    int status_code = 0;
-    if (state.result.x != -1) {
-        resolve_result_output(&state);
-        print_result(&state);
-        if (!only_print) {
-            move_pointer(
-                &state, state.result.x + state.result.w / 2,
-                state.result.y + state.result.h / 2, state.click
-            );
-        }
-    } else {
-        status_code = state.config.general.cancellation_status_code;
-    }
+    int status_code = options.daemon ? run_daemon(&state)
+                                     : run_session(&state, &options, stdout);
+    free_cli_options(&options);
 
     if (state.wl_virtual_pointer_mgr != NULL) {
         zwlr_virtual_pointer_manager_v1_destroy(state.wl_virtual_pointer_mgr);
@@ -1104,6 +2749,7 @@ int main(int argc, char **argv) {
 
     free_seats(&state.seats);
     free_outputs(&state.outputs);
+    arena_finish(&state.mode_arena);
 
     zxdg_output_manager_v1_destroy(state.xdg_output_manager);
 
@@ -1111,8 +2757,15 @@ int main(int argc, char **argv) {
         wp_fractional_scale_manager_v1_destroy(state.fractional_scale_mgr);
     }
 
+    if (state.single_pixel_buffer_mgr) {
+        wp_single_pixel_buffer_manager_v1_destroy(
+            state.single_pixel_buffer_mgr
+        );
+    }
+
     wp_viewporter_destroy(state.wp_viewporter);
     wl_shm_destroy(state.wl_shm);
+    wl_subcompositor_destroy(state.wl_subcompositor);
     wl_compositor_destroy(state.wl_compositor);
     wl_registry_destroy(state.wl_registry);
     zwlr_layer_shell_v1_destroy(state.wl_layer_shell);
@@ -1123,10 +2776,12 @@ int main(int argc, char **argv) {
     }
 #endif
 
+    event_loop_finish(&state.event_loop);
     wl_display_disconnect(state.wl_display);
 
     config_free_values(&state.config);
-    free_mode_states(&state);
+
+    trace_close();
 
 #if DEBUG
     cairo_debug_reset_static_data();
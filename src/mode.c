@@ -74,8 +74,11 @@ void enter_next_mode(struct state *state, struct rect area) {
         return;
     }
 
+    state->mode_marks[state->current_mode] = arena_save(&state->mode_arena);
     state->mode_states[state->current_mode] =
-        state->mode_interfaces[state->current_mode]->enter(state, area);
+        state->mode_interfaces[state->current_mode]->enter(
+            state, &state->mode_arena, area
+        );
 }
 
 bool has_last_mode_returned(struct state *state) {
@@ -92,6 +95,7 @@ bool reenter_prev_mode(struct state *state) {
     if (current_mode_state != NULL) {
         state->mode_interfaces[state->current_mode]->free(current_mode_state);
     }
+    arena_release(&state->mode_arena, state->mode_marks[state->current_mode]);
 
     state->current_mode--;
     state->mode_interfaces[state->current_mode]->reenter(
@@ -109,11 +113,14 @@ void free_mode_states(struct state *state) {
     for (int i = 0; i <= state->current_mode; i++) {
         if (state->mode_interfaces[i] == NULL ||
             state->mode_states[i] == NULL) {
-            return;
+            break;
         }
 
         state->mode_interfaces[i]->free(state->mode_states[i]);
     }
+
+    // The chunks are kept for the next session.
+    arena_release(&state->mode_arena, state->mode_marks[0]);
 }
 
 bool mode_handle_key(struct state *state, xkb_keysym_t sym, char *text) {
@@ -125,12 +132,70 @@ bool mode_handle_key(struct state *state, xkb_keysym_t sym, char *text) {
         state, state->mode_states[state->current_mode], sym, text
     );
 }
-void mode_render(struct state *state, cairo_t *cairo) {
+void mode_render(struct state *state, cairo_t *cairo, struct rect clip) {
     if (has_last_mode_returned(state)) {
         return;
     }
 
     return state->mode_interfaces[state->current_mode]->render(
-        state, state->mode_states[state->current_mode], cairo
+        state, state->mode_states[state->current_mode], cairo, clip
+    );
+}
+
+void mode_damage(struct state *state, struct damage *damage) {
+    if (has_last_mode_returned(state) ||
+        state->mode_interfaces[state->current_mode]->damage == NULL) {
+        damage_set_full(damage);
+        return;
+    }
+
+    state->mode_interfaces[state->current_mode]->damage(
+        state, state->mode_states[state->current_mode], damage
+    );
+}
+
+bool mode_content_bounds(
+    struct state *state, struct rect *bounds, uint32_t *bg_color
+) {
+    if (has_last_mode_returned(state) ||
+        state->mode_interfaces[state->current_mode]->content_bounds == NULL) {
+        return false;
+    }
+
+    *bounds = state->mode_interfaces[state->current_mode]->content_bounds(
+        state, state->mode_states[state->current_mode], bg_color
+    );
+    return true;
+}
+
+int mode_num_candidates(struct state *state) {
+    if (has_last_mode_returned(state) ||
+        state->mode_interfaces[state->current_mode]->num_candidates == NULL) {
+        return 0;
+    }
+
+    return state->mode_interfaces[state->current_mode]->num_candidates(
+        state, state->mode_states[state->current_mode]
+    );
+}
+
+bool mode_select_candidate(struct state *state, int i) {
+    return state->mode_interfaces[state->current_mode]->select_candidate(
+        state, state->mode_states[state->current_mode], i
+    );
+}
+
+uint64_t mode_frame_id(struct state *state) {
+    if (has_last_mode_returned(state) ||
+        state->mode_interfaces[state->current_mode]->frame_id == NULL) {
+        return 0;
+    }
+
+    // Different modes never render the same frame.
+    return fnv1a(
+        state->mode_interfaces[state->current_mode]->frame_id(
+            state, state->mode_states[state->current_mode]
+        ),
+        &state->current_mode, sizeof(state->current_mode)
     );
 }
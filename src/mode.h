@@ -1,6 +1,8 @@
 #ifndef __MODE_H_INCLUDED__
 #define __MODE_H_INCLUDED__
 
+#include "arena.h"
+#include "damage.h"
 #include "state.h"
 
 #include <cairo.h>
@@ -9,11 +11,41 @@
 
 struct mode_interface {
     char *name;
-    void *(*enter)(struct state *, struct rect area);
+    // Allocates the mode's state, and whatever lives as long as it, in the
+    // arena. The arena is released back when the mode is left, so `free` only
+    // releases the mode's other resources.
+    void *(*enter)(struct state *, struct arena *, struct rect area);
     void (*reenter)(struct state *, void *mode_state);
     bool (*key)(struct state *, void *mode_state, xkb_keysym_t, char *text);
-    void (*render)(struct state *, void *mode_state, cairo_t *);
+    // `clip` is the part of the surface being drawn, in the coordinates the
+    // mode renders in. Anything outside of it can be skipped. Overlays and
+    // bands of a frame are rendered concurrently, each with its own clip, so
+    // this must not modify the mode's state.
+    void (*render)(
+        struct state *, void *mode_state, cairo_t *, struct rect clip
+    );
     void (*free)(void *mode_state);
+
+    // Optional. Adds the areas whose rendering depends on the current
+    // selection. The damage of a key press is the union of the areas reported
+    // before and after it. Modes without it are fully redrawn.
+    void (*damage)(struct state *, void *mode_state, struct damage *);
+
+    // Optional. Returns the area outside of which the mode only paints its
+    // background, setting `bg_color` to it. The overlay then only renders that
+    // area and shows the background with solid buffers.
+    struct rect (*content_bounds)(
+        struct state *, void *mode_state, uint32_t *bg_color
+    );
+
+    // Optional, to render frames ahead. `num_candidates` returns the number
+    // of keys whose frame can be predicted. `select_candidate` puts the mode
+    // in the state the `i`-th of them would lead to, or back in the current
+    // state when `i` is -1. It returns false when the key's frame can't be
+    // predicted. `frame_id` identifies what the mode renders in its state.
+    int (*num_candidates)(struct state *, void *mode_state);
+    bool (*select_candidate)(struct state *, void *mode_state, int i);
+    uint64_t (*frame_id)(struct state *, void *mode_state);
 };
 
 extern struct mode_interface *mode_interfaces[];
@@ -29,6 +61,16 @@ bool has_last_mode_returned(struct state *);
 bool reenter_prev_mode(struct state *);
 void free_mode_states(struct state *);
 bool mode_handle_key(struct state *, xkb_keysym_t, char *text);
-void mode_render(struct state *, cairo_t *);
+void mode_render(struct state *, cairo_t *, struct rect clip);
+void mode_damage(struct state *, struct damage *);
+
+// Returns false when the mode doesn't report its content bounds.
+bool mode_content_bounds(
+    struct state *, struct rect *bounds, uint32_t *bg_color
+);
+
+int      mode_num_candidates(struct state *);
+bool     mode_select_candidate(struct state *, int i);
+uint64_t mode_frame_id(struct state *);
 
 #endif
@@ -1,5 +1,7 @@
+#include "builtin_font.h"
 #include "config.h"
 #include "mode.h"
+#include "painter.h"
 #include "state.h"
 #include "utils.h"
 #include "utils_cairo.h"
@@ -65,15 +67,14 @@ bisect_mode_move_pointer(struct state *state, struct bisect_mode_state *ms) {
     move_pointer(state, r->x + r->w / 2, r->y + r->h / 2, CLICK_NONE);
 }
 
-void *bisect_mode_enter(struct state *state, struct rect area) {
-    struct bisect_mode_state *ms = malloc(sizeof(*ms));
+void *
+bisect_mode_enter(struct state *state, struct arena *arena, struct rect area) {
+    struct bisect_mode_state *ms = arena_alloc(arena, sizeof(*ms));
     ms->areas[0]                 = area;
     ms->current                  = 0;
 
-    ms->label_font_face = cairo_toy_font_face_create(
-        state->config.mode_bisect.label_font_family, CAIRO_FONT_SLANT_NORMAL,
-        CAIRO_FONT_WEIGHT_NORMAL
-    );
+    ms->label_font_face =
+        label_font_face_create(state->config.mode_bisect.label_font_family);
 
     bisect_mode_move_pointer(state, ms);
 
@@ -388,27 +389,52 @@ static const struct division_interface division_interfaces[] = {
     },
 };
 
-static void
-bisect_mode_render(struct state *state, void *mode_state, cairo_t *cairo) {
+// `bisect_area_bounds` returns the area covered by the divisions of `area`, their
+// labels drawn around it and the pointer.
+static struct rect
+bisect_area_bounds(struct mode_bisect_config *config, struct rect *area) {
+    // The outer labels are at most a few symbols wide.
+    int margin = config->label_padding + 4 * config->label_font_size +
+                 config->pointer_size;
+
+    return (struct rect){
+        .x = area->x - margin,
+        .y = area->y - margin,
+        .w = area->w + 2 * margin,
+        .h = area->h + 2 * margin,
+    };
+}
+
+static void bisect_mode_render(
+    struct state *state, void *mode_state, cairo_t *cairo, struct rect clip
+) {
     struct mode_bisect_config *config = &state->config.mode_bisect;
     struct bisect_mode_state  *ms     = mode_state;
     struct rect               *area   = &ms->areas[ms->current];
 
-    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
-    cairo_set_source_u32(cairo, config->unselectable_bg_color);
-    cairo_paint(cairo);
+    struct painter painter;
+    painter_init(&painter, cairo, state->config.general.render_backend);
 
-    cairo_set_source_u32(cairo, config->history_border_color);
-    cairo_set_line_width(cairo, 1);
+    painter_paint(&painter, config->unselectable_bg_color);
 
     for (int i = 0; i < ms->current; i++) {
         struct rect *area = &ms->areas[i];
-        cairo_rectangle(
-            cairo, area->x + .5, area->y + .5, area->w - 1, area->h - 1
-        );
-        cairo_stroke(cairo);
+        if (rect_intersects(*area, clip)) {
+            painter_border(
+                &painter, *area, config->history_border_color,
+                CAIRO_OPERATOR_SOURCE
+            );
+        }
     }
 
+    painter_finish(&painter);
+
+    if (!rect_intersects(bisect_area_bounds(config, area), clip)) {
+        return;
+    }
+
+    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+
     if (ms->current < BISECT_MAX_HISTORY) {
         enum bisect_division division = determine_division(area);
         division_interfaces[division].render(division, state, ms, cairo);
@@ -465,7 +491,10 @@ static bool bisect_mode_key(
         struct rect         *area     = &ms->areas[ms->current];
         enum bisect_division division = determine_division(area);
 
-        int matched_i = find_str(state->home_row, HOME_ROW_LEN_WITH_BTN, text);
+        int matched_i = keysym_map_find_str(
+            &state->home_row_map, state->home_row, HOME_ROW_LEN_WITH_BTN,
+            keysym, text
+        );
         if (matched_i < 0) {
             return false;
         }
@@ -504,13 +533,65 @@ static bool bisect_mode_key(
     return false;
 }
 
+static struct rect bisect_mode_content_bounds(
+    struct state *state, void *mode_state, uint32_t *bg_color
+) {
+    struct mode_bisect_config *config = &state->config.mode_bisect;
+    struct bisect_mode_state  *ms     = mode_state;
+
+    struct rect bounds = bisect_area_bounds(config, &ms->areas[ms->current]);
+    for (int i = 0; i < ms->current; i++) {
+        bounds = rect_union(bounds, ms->areas[i]);
+    }
+
+    *bg_color = config->unselectable_bg_color;
+    return bounds;
+}
+
+static int bisect_mode_num_candidates(struct state *state, void *mode_state) {
+    struct bisect_mode_state *ms = mode_state;
+    if (ms->current + 1 >= BISECT_MAX_HISTORY ||
+        determine_division(&ms->areas[ms->current]) == UNDIVIDABLE) {
+        return 0;
+    }
+
+    return HOME_ROW_LEN;
+}
+
+static bool
+bisect_mode_select_candidate(struct state *state, void *mode_state, int i) {
+    struct bisect_mode_state *ms = mode_state;
+
+    if (i < 0) {
+        ms->current--;
+        return true;
+    }
+
+    struct rect         *area     = &ms->areas[ms->current];
+    enum bisect_division division = determine_division(area);
+    if (!division_interfaces[division].idx_to_sub_area(
+            division, i, area, &ms->areas[ms->current + 1]
+        )) {
+        return false;
+    }
+
+    ms->current++;
+    return true;
+}
+
+static uint64_t bisect_mode_frame_id(struct state *state, void *mode_state) {
+    struct bisect_mode_state *ms = mode_state;
+
+    uint64_t id = fnv1a(FNV1A_INIT, &ms->current, sizeof(ms->current));
+    return fnv1a(id, ms->areas, (ms->current + 1) * sizeof(struct rect));
+}
+
 void bisect_mode_reenter(struct state *state, void *mode_state) {
     bisect_mode_move_pointer(state, mode_state);
 }
 void bisect_mode_free(void *mode_state) {
     struct bisect_mode_state *ms = mode_state;
     cairo_font_face_destroy(ms->label_font_face);
-    free(ms);
 }
 
 struct mode_interface bisect_mode_interface = {
@@ -520,4 +601,9 @@ struct mode_interface bisect_mode_interface = {
     .key     = bisect_mode_key,
     .render  = bisect_mode_render,
     .free    = bisect_mode_free,
+
+    .content_bounds   = bisect_mode_content_bounds,
+    .num_candidates   = bisect_mode_num_candidates,
+    .select_candidate = bisect_mode_select_candidate,
+    .frame_id         = bisect_mode_frame_id,
 };
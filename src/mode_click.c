@@ -1,6 +1,7 @@
 #include "mode.h"
 
-static void *click_mode_enter(struct state *state, struct rect area) {
+static void *
+click_mode_enter(struct state *state, struct arena *arena, struct rect area) {
     state->click = state->config.mode_click.button;
     enter_next_mode(state, area);
     return NULL;
@@ -16,8 +17,9 @@ static bool click_mode_key(
     return false;
 }
 
-static void
-click_mode_render(struct state *state, void *mode_state, cairo_t *cairo) {}
+static void click_mode_render(
+    struct state *state, void *mode_state, cairo_t *cairo, struct rect clip
+) {}
 
 static void click_mode_free(void *mode_state) {}
 
@@ -1,9 +1,13 @@
+#include "builtin_font.h"
 #include "config.h"
+#include "input_buffer.h"
 #include "log.h"
 #include "mode.h"
+#include "painter.h"
 #include "screencopy.h"
 #include "state.h"
 #include "target_detection.h"
+#include "trace.h"
 #include "utils.h"
 #include "utils_cairo.h"
 
@@ -16,14 +20,34 @@
 
 #define MIN_SUB_AREA_SIZE (25 * 50)
 
-static void get_areas_from_stdin(struct floating_mode_state *ms) {
+static void
+get_areas_from_stdin(struct floating_mode_state *ms, struct state *state) {
     size_t       areas_cap   = 256;
     struct rect *areas       = malloc(sizeof(struct rect) * areas_cap);
     int          areas_count = 0;
     char        *buf         = NULL;
     size_t       buf_n       = 0;
 
-    while (getline(&buf, &buf_n, stdin) >= 0) {
+    // The input is usually read entirely while the overlay is being set up.
+    struct input_buffer *input_buffer = &state->input_buffer;
+    int                  fd           = fileno(state->input);
+    while (!input_buffer->done) {
+        if (!event_loop_wait_fd(&state->event_loop, fd)) {
+            state->running = false;
+            break;
+        }
+
+        if (input_buffer_read(input_buffer, fd)) {
+            event_loop_remove_fd(&state->event_loop, fd);
+        }
+    }
+
+    FILE *input = NULL;
+    if (input_buffer->len > 0) {
+        input = fmemopen(input_buffer->data, input_buffer->len, "r");
+    }
+
+    while (input != NULL && getline(&buf, &buf_n, input) >= 0) {
         if (areas_count >= areas_cap) {
             areas_cap *= 2;
             areas      = realloc(areas, sizeof(struct rect) * areas_cap);
@@ -43,6 +67,9 @@ static void get_areas_from_stdin(struct floating_mode_state *ms) {
     }
 
     free(buf);
+    if (input != NULL) {
+        fclose(input);
+    }
 
     LOG_INFO("Got %d areas.", areas_count);
 
@@ -61,35 +88,50 @@ static void get_area_from_screenshot(
     area.h -= 2;
     area.w -= 2;
 
-    struct scrcpy_buffer    *scrcpy_buffer = query_screenshot(state, area);
+    struct scrcpy_buffer *scrcpy_buffer = query_screenshot(state, area);
+    if (scrcpy_buffer == NULL) {
+        ms->areas     = NULL;
+        ms->num_areas = 0;
+        return;
+    }
+
     enum wl_output_transform output_transform =
         state->current_output->transform;
+
+    TRACE_BEGIN(detect_start);
     ms->num_areas = compute_target_from_img_buffer(
         scrcpy_buffer->data, scrcpy_buffer->height, scrcpy_buffer->width,
         scrcpy_buffer->stride, scrcpy_buffer->format, output_transform, area,
         &ms->areas
     );
+    TRACE_END("compute_target_from_img_buffer", detect_start);
     destroy_scrcpy_buffer(scrcpy_buffer);
 }
 
 #endif
 
-void *floating_mode_enter(struct state *state, struct rect area) {
-    struct floating_mode_state *ms = malloc(sizeof(*ms));
+void *floating_mode_enter(
+    struct state *state, struct arena *arena, struct rect area
+) {
+    struct floating_mode_state *ms = arena_alloc(arena, sizeof(*ms));
 
-    ms->label_symbols =
-        label_symbols_from_str(state->config.mode_floating.label_symbols);
+    char *symbols      = state->config.mode_floating.label_symbols;
+    int   symbols_size = label_symbols_size(symbols);
 
-    if (ms->label_symbols == NULL) {
+    if (symbols_size < 0) {
         ms->areas           = NULL;
         ms->label_selection = NULL;
         state->running      = false;
         return ms;
     }
 
+    ms->label_symbols =
+        label_symbols_init(arena_alloc(arena, symbols_size), symbols);
+    keysym_map_init_label_symbols(&ms->symbol_map, ms->label_symbols);
+
     switch (state->config.mode_floating.source) {
     case FLOATING_MODE_SOURCE_STDIN:
-        get_areas_from_stdin(ms);
+        get_areas_from_stdin(ms, state);
         break;
     case FLOATING_MODE_SOURCE_DETECT:
 #if OPENCV_ENABLED
@@ -103,11 +145,15 @@ void *floating_mode_enter(struct state *state, struct rect area) {
         break;
     }
 
-    ms->label_selection = label_selection_new(ms->label_symbols, ms->num_areas);
+    ms->label_selection = label_selection_init(
+        arena_alloc(arena, label_selection_size(ms->label_symbols)),
+        ms->label_symbols, ms->num_areas
+    );
 
-    ms->label_font_face = cairo_toy_font_face_create(
-        state->config.mode_floating.label_font_family, CAIRO_FONT_SLANT_NORMAL,
-        CAIRO_FONT_WEIGHT_NORMAL
+    ms->label_font_face =
+        label_font_face_create(state->config.mode_floating.label_font_family);
+    glyph_atlas_cache_init(
+        &ms->glyph_atlases, ms->label_font_face, ms->label_symbols
     );
 
     return ms;
@@ -131,7 +177,9 @@ static bool floating_mode_key(
         state->running = false;
         break;
     default:;
-        int symbol_idx = label_symbols_find_idx(ms->label_symbols, text);
+        int symbol_idx = keysym_map_find_label_symbol(
+            &ms->symbol_map, ms->label_symbols, keysym, text
+        );
         if (symbol_idx < 0) {
             return false;
         }
@@ -149,101 +197,102 @@ static bool floating_mode_key(
 }
 
 void floating_mode_render(
-    struct state *state, void *mode_state, cairo_t *cairo
+    struct state *state, void *mode_state, cairo_t *cairo, struct rect clip
 ) {
     struct floating_mode_state  *ms     = mode_state;
     struct mode_floating_config *config = &state->config.mode_floating;
 
-    label_selection_t *curr_label =
-        label_selection_new(ms->label_symbols, ms->num_areas);
-    label_selection_set_from_idx(curr_label, 0);
+    _Alignas(label_selection_t) char curr_label_buf[LABEL_SELECTION_MAX_SIZE];
+    label_selection_t *curr_label = label_selection_init(
+        curr_label_buf, ms->label_symbols, ms->num_areas
+    );
 
-    int  label_str_max_len = label_selection_str_max_len(curr_label) + 1;
-    char label_selected_str[label_str_max_len];
-    char label_unselected_str[label_str_max_len];
+    struct painter painter;
+    painter_init(&painter, cairo, state->config.general.render_backend);
 
-    cairo_set_font_face(cairo, ms->label_font_face);
+    painter_paint(&painter, config->unselectable_bg_color);
 
-    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
-    cairo_set_source_u32(cairo, config->unselectable_bg_color);
-    cairo_paint(cairo);
+    // Only the areas whose label starts with the selection and which are
+    // visible in the clip are drawn.
+    int first, stride;
+    label_selection_matching(ms->label_selection, &first, &stride);
 
-    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
-    for (int i = 0; i < ms->num_areas; i++) {
-        const bool selectable =
-            label_selection_is_included(curr_label, ms->label_selection);
+    for (int i = first; i < ms->num_areas; i += stride) {
+        struct rect a = ms->areas[i];
+        if (rect_intersects(a, clip)) {
+            painter_fill(&painter, a, 0, CAIRO_OPERATOR_SOURCE);
+        }
+    }
 
-        if (selectable) {
-            struct rect a = ms->areas[i];
-            cairo_set_source_rgba(cairo, 0, 0, 0, 0);
-            cairo_rectangle(cairo, a.x, a.y, a.w, a.h);
-            cairo_fill(cairo);
+    for (int i = first; i < ms->num_areas; i += stride) {
+        struct rect a = ms->areas[i];
+        double      font_size =
+            compute_relative_font_size(&config->label_font_size, a.h);
+        if (!rect_intersects(
+                damage_label_rect(a, curr_label->len, font_size), clip
+            )) {
+            continue;
         }
 
-        label_selection_incr(curr_label);
+        label_selection_set_from_idx(curr_label, i);
+
+        painter_fill(
+            &painter, a, config->selectable_bg_color, CAIRO_OPERATOR_OVER
+        );
+        painter_border(
+            &painter, a, config->selectable_border_color, CAIRO_OPERATOR_SOURCE
+        );
+
+        struct glyph_atlas *atlas =
+            glyph_atlas_cache_get(&ms->glyph_atlases, cairo, font_size);
+        painter_draw_label(
+            &painter, atlas, curr_label, ms->label_selection->next, a,
+            config->label_select_color, config->label_color,
+            CAIRO_OPERATOR_OVER
+        );
+        glyph_atlas_release(&ms->glyph_atlases, atlas);
     }
 
-    label_selection_set_from_idx(curr_label, 0);
-    for (int i = 0; i < ms->num_areas; i++) {
-        struct rect a = ms->areas[i];
+    painter_finish(&painter);
+}
 
-        const bool selectable =
-            label_selection_is_included(curr_label, ms->label_selection);
-
-        if (selectable) {
-            cairo_set_operator(cairo, CAIRO_OPERATOR_OVER);
-            cairo_set_source_u32(cairo, config->selectable_bg_color);
-            cairo_rectangle(cairo, a.x, a.y, a.w, a.h);
-            cairo_fill(cairo);
-
-            cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
-            cairo_set_source_u32(cairo, config->selectable_border_color);
-            cairo_rectangle(cairo, a.x + .5, a.y + .5, a.w - 1, a.h - 1);
-            cairo_set_line_width(cairo, 1);
-            cairo_stroke(cairo);
-
-            cairo_set_font_size(
-                cairo, compute_relative_font_size(&config->label_font_size, a.h)
-            );
-            cairo_text_extents_t te_all;
-            label_selection_str(curr_label, label_selected_str);
-            cairo_text_extents(cairo, label_selected_str, &te_all);
-
-            label_selection_str_split(
-                curr_label, label_selected_str, label_unselected_str,
-                ms->label_selection->next
-            );
-
-            cairo_text_extents_t te_selected, te_unselected;
-            cairo_text_extents(cairo, label_selected_str, &te_selected);
-            cairo_text_extents(cairo, label_unselected_str, &te_unselected);
-
-            cairo_move_to(
-                cairo,
-                a.x +
-                    (a.w - te_selected.x_advance - te_unselected.x_advance) / 2,
-                a.y + (int)((a.h + te_all.height) / 2)
-            );
-            cairo_set_operator(cairo, CAIRO_OPERATOR_OVER);
-            cairo_set_source_u32(cairo, config->label_select_color);
-            cairo_show_text(cairo, label_selected_str);
-            cairo_set_source_u32(cairo, config->label_color);
-            cairo_show_text(cairo, label_unselected_str);
-        }
+static void floating_mode_damage(
+    struct state *state, void *mode_state, struct damage *damage
+) {
+    struct floating_mode_state  *ms     = mode_state;
+    struct mode_floating_config *config = &state->config.mode_floating;
 
-        label_selection_incr(curr_label);
+    int first, stride;
+    label_selection_matching(ms->label_selection, &first, &stride);
+    for (int i = first; i < ms->num_areas; i += stride) {
+        struct rect a = ms->areas[i];
+        damage_add(
+            damage,
+            damage_label_rect(
+                a, ms->label_selection->len,
+                compute_relative_font_size(&config->label_font_size, a.h)
+            )
+        );
     }
+}
 
-    label_selection_free(curr_label);
+static struct rect floating_mode_content_bounds(
+    struct state *state, void *mode_state, uint32_t *bg_color
+) {
+    // Everything but the matching areas is the background.
+    struct damage damage;
+    damage_clear(&damage);
+    floating_mode_damage(state, mode_state, &damage);
+
+    *bg_color = state->config.mode_floating.unselectable_bg_color;
+    return damage_extents(&damage);
 }
 
 void floating_mode_free(void *mode_state) {
     struct floating_mode_state *ms = mode_state;
     free(ms->areas);
+    glyph_atlas_cache_free(&ms->glyph_atlases);
     cairo_font_face_destroy(ms->label_font_face);
-    label_selection_free(ms->label_selection);
-    label_symbols_free(ms->label_symbols);
-    free(ms);
 }
 
 struct mode_interface floating_mode_interface = {
@@ -253,4 +302,7 @@ struct mode_interface floating_mode_interface = {
     .key     = floating_mode_key,
     .render  = floating_mode_render,
     .free    = floating_mode_free,
+    .damage  = floating_mode_damage,
+
+    .content_bounds = floating_mode_content_bounds,
 };
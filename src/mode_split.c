@@ -1,5 +1,6 @@
 #include "config.h"
 #include "mode.h"
+#include "painter.h"
 #include "state.h"
 #include "utils.h"
 #include "utils_cairo.h"
@@ -23,8 +24,9 @@ split_mode_move_pointer(struct state *state, struct split_mode_state *ms) {
     move_pointer(state, r->x + r->w / 2, r->y + r->h / 2, CLICK_NONE);
 }
 
-void *split_mode_enter(struct state *state, struct rect area) {
-    struct split_mode_state *ms = malloc(sizeof(*ms));
+void *
+split_mode_enter(struct state *state, struct arena *arena, struct rect area) {
+    struct split_mode_state *ms = arena_alloc(arena, sizeof(*ms));
     ms->areas[0]                = area;
     ms->current                 = 0;
 
@@ -185,27 +187,50 @@ static void split_mode_render_markers(
     }
 }
 
-static void
-split_mode_render(struct state *state, void *mode_state, cairo_t *cairo) {
+// `split_area_bounds` returns the area covered by `area` and the pointer and
+// arrows drawn around it.
+static struct rect
+split_area_bounds(struct mode_split_config *config, struct rect *area) {
+    int margin = config->pointer_size + ARROW_SIZE;
+
+    return (struct rect){
+        .x = area->x - margin,
+        .y = area->y - margin,
+        .w = area->w + 2 * margin,
+        .h = area->h + 2 * margin,
+    };
+}
+
+static void split_mode_render(
+    struct state *state, void *mode_state, cairo_t *cairo, struct rect clip
+) {
     struct mode_split_config *config = &state->config.mode_split;
     struct split_mode_state  *ms     = mode_state;
 
-    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
-    cairo_set_source_u32(cairo, config->bg_color);
-    cairo_paint(cairo);
+    struct painter painter;
+    painter_init(&painter, cairo, state->config.general.render_backend);
 
-    cairo_set_source_u32(cairo, config->history_border_color);
-    cairo_set_line_width(cairo, 1);
+    painter_paint(&painter, config->bg_color);
 
     for (int i = 0; i <= ms->current; i++) {
         struct rect *area = &ms->areas[i];
-        cairo_rectangle(
-            cairo, area->x + .5, area->y + .5, area->w - 1, area->h - 1
-        );
-        cairo_stroke(cairo);
+        if (rect_intersects(*area, clip)) {
+            painter_border(
+                &painter, *area, config->history_border_color,
+                CAIRO_OPERATOR_SOURCE
+            );
+        }
     }
 
+    painter_finish(&painter);
+
+    // Skip the current area when it's not visible.
     struct rect *area = &ms->areas[ms->current];
+    if (!rect_intersects(split_area_bounds(config, area), clip)) {
+        return;
+    }
+
+    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
     cairo_set_source_u32(cairo, config->area_bg_color);
     cairo_rectangle(
         cairo, area->x + .5, area->y + .5, area->w - 1, area->h - 1
@@ -305,7 +330,10 @@ static bool split_mode_key(
         return split_mode_split(state, mode_state, SPLIT_DIR_DOWN);
     }
 
-    int matched_i = find_str(state->home_row, HOME_ROW_LEN_WITH_BTN, text);
+    int matched_i = keysym_map_find_str(
+        &state->home_row_map, state->home_row, HOME_ROW_LEN_WITH_BTN, keysym,
+        text
+    );
     switch (matched_i) {
     case HOME_ROW_LEFT_CLICK:
         state->click = CLICK_LEFT_BTN;
@@ -348,12 +376,25 @@ static bool split_mode_key(
     return false;
 }
 
+static struct rect split_mode_content_bounds(
+    struct state *state, void *mode_state, uint32_t *bg_color
+) {
+    struct mode_split_config *config = &state->config.mode_split;
+    struct split_mode_state  *ms     = mode_state;
+
+    struct rect bounds = split_area_bounds(config, &ms->areas[ms->current]);
+    for (int i = 0; i < ms->current; i++) {
+        bounds = rect_union(bounds, ms->areas[i]);
+    }
+
+    *bg_color = config->bg_color;
+    return bounds;
+}
+
 void split_mode_reenter(struct state *state, void *mode_state) {
     split_mode_move_pointer(state, mode_state);
 }
-void split_mode_free(void *mode_state) {
-    free(mode_state);
-}
+void split_mode_free(void *mode_state) {}
 
 struct mode_interface split_mode_interface = {
     .name    = "split",
@@ -362,4 +403,6 @@ struct mode_interface split_mode_interface = {
     .key     = split_mode_key,
     .render  = split_mode_render,
     .free    = split_mode_free,
+
+    .content_bounds = split_mode_content_bounds,
 };
@@ -1,6 +1,8 @@
+#include "builtin_font.h"
 #include "config.h"
 #include "label.h"
 #include "mode.h"
+#include "painter.h"
 #include "state.h"
 #include "utils.h"
 #include "utils_cairo.h"
@@ -13,19 +15,122 @@
 
 #define MIN_SUB_AREA_SIZE (25 * 50)
 
-void *tile_mode_enter(struct state *state, struct rect area) {
-    struct tile_mode_state *ms = calloc(1, sizeof(*ms));
+struct curve_cell {
+    uint64_t curve_idx;
+    int      cell;
+};
+
+static int compare_curve_cells(const void *a, const void *b) {
+    const struct curve_cell *ca = a;
+    const struct curve_cell *cb = b;
+    return (ca->curve_idx > cb->curve_idx) - (ca->curve_idx < cb->curve_idx);
+}
+
+// `region_cell_to_rect` returns the rect of the cell counted column by column
+// in the region's grid.
+static struct rect region_cell_to_rect(struct tile_region *r, int cell) {
+    int col = cell / r->rows;
+    int row = cell % r->rows;
+
+    return (struct rect){
+        .x = r->area.x + col * r->cell_w + min(col, r->cell_w_off),
+        .w = r->cell_w + (col < r->cell_w_off ? 1 : 0),
+        .y = r->area.y + row * r->cell_h + min(row, r->cell_h_off),
+        .h = r->cell_h + (row < r->cell_h_off ? 1 : 0),
+    };
+}
+
+// `order_cells_along_curve` sets `cells` to the cell of each label of the
+// region. Cells are taken along the curve and labels by prefix, so that the
+// labels sharing a prefix cover a compact block of cells.
+static void order_cells_along_curve(
+    struct arena *arena, label_selection_t *selection, enum label_order order,
+    struct tile_region *r, int *cells
+) {
+    // Grids that aren't a power of 2 square are ranked along the curve of the
+    // smallest such square covering them.
+    int bits = 0;
+    while ((1 << bits) < max(r->cols, r->rows)) {
+        bits++;
+    }
+
+    struct curve_cell *curve =
+        arena_alloc(arena, r->num_labels * sizeof(*curve));
+    for (int col = 0; col < r->cols; col++) {
+        for (int row = 0; row < r->rows; row++) {
+            struct curve_cell *c = &curve[col * r->rows + row];
+            c->cell              = col * r->rows + row;
+            c->curve_idx         = order == LABEL_ORDER_HILBERT
+                                       ? hilbert_curve_idx(bits, col, row)
+                                       : z_curve_idx(col, row);
+        }
+    }
+    qsort(curve, r->num_labels, sizeof(*curve), compare_curve_cells);
+
+    int *labels = arena_alloc(arena, r->num_labels * sizeof(*labels));
+    label_selection_prefix_order(
+        selection, r->label_offset, r->label_offset + r->num_labels, labels
+    );
+    for (int i = 0; i < r->num_labels; i++) {
+        cells[labels[i] - r->label_offset] = curve[i].cell;
+    }
+}
+
+// `layout_region` sets the cells of the region's labels in the layout.
+static void layout_region(
+    struct tile_mode_state *ms, struct arena *arena, enum label_order order,
+    struct tile_region *r
+) {
+    // The cells' order is only needed here.
+    struct arena_mark mark = arena_save(arena);
+    int *cells = arena_alloc(arena, r->num_labels * sizeof(*cells));
+    if (order == LABEL_ORDER_COLUMN) {
+        for (int i = 0; i < r->num_labels; i++) {
+            cells[i] = i;
+        }
+    } else {
+        order_cells_along_curve(arena, ms->label_selection, order, r, cells);
+    }
+
+    struct tile_layout *layout = &ms->layout;
+    for (int i = 0; i < r->num_labels; i++) {
+        struct rect cell = region_cell_to_rect(r, cells[i]);
+        int         idx  = r->label_offset + i;
+        layout->x[idx]   = cell.x;
+        layout->y[idx]   = cell.y;
+        layout->w[idx]   = cell.w;
+        layout->h[idx]   = cell.h;
+    }
+
+    arena_release(arena, mark);
+}
+
+static void
+layout_init(struct tile_layout *layout, struct arena *arena, int num_labels) {
+    layout->x = arena_alloc(arena, 4 * num_labels * sizeof(int32_t));
+    layout->y = layout->x + num_labels;
+    layout->w = layout->y + num_labels;
+    layout->h = layout->w + num_labels;
+}
+
+void *
+tile_mode_enter(struct state *state, struct arena *arena, struct rect area) {
+    struct tile_mode_state *ms = arena_alloc(arena, sizeof(*ms));
     ms->area                   = area;
 
-    const int max_num_sub_areas = 26 * 26;
+    const int        max_num_sub_areas = 26 * 26;
+    enum label_order label_order       = state->config.mode_tile.label_order;
 
-    ms->label_symbols =
-        label_symbols_from_str(state->config.mode_tile.label_symbols);
-    if (ms->label_symbols == NULL) {
+    char *symbols      = state->config.mode_tile.label_symbols;
+    int   symbols_size = label_symbols_size(symbols);
+    if (symbols_size < 0) {
         ms->label_selection = NULL;
         state->running      = false;
         return ms;
     }
+    ms->label_symbols =
+        label_symbols_init(arena_alloc(arena, symbols_size), symbols);
+    keysym_map_init_label_symbols(&ms->symbol_map, ms->label_symbols);
 
     if (state->config.general.all_outputs &&
         !wl_list_empty(&state->overlay_surfaces)) {
@@ -56,7 +161,7 @@ void *tile_mode_enter(struct state *state, struct rect area) {
         int cell_w = max((int)sqrt(sub_area_size * 2.), 1);
 
         // Allocate region array (one entry per output with a known position).
-        ms->regions     = malloc(n * sizeof(struct tile_region));
+        ms->regions     = arena_alloc(arena, n * sizeof(struct tile_region));
         ms->num_regions = 0;
         int label_offset = 0;
 
@@ -83,8 +188,15 @@ void *tile_mode_enter(struct state *state, struct rect area) {
             label_offset += r->num_labels;
         }
 
-        ms->label_selection =
-            label_selection_new(ms->label_symbols, label_offset);
+        ms->label_selection = label_selection_init(
+            arena_alloc(arena, label_selection_size(ms->label_symbols)),
+            ms->label_symbols, label_offset
+        );
+
+        layout_init(&ms->layout, arena, label_offset);
+        for (int ri = 0; ri < ms->num_regions; ri++) {
+            layout_region(ms, arena, label_order, &ms->regions[ri]);
+        }
     } else {
         // Single-output path: flat grid over the whole area.
         int32_t density_area = ms->area.w * ms->area.h;
@@ -108,12 +220,31 @@ void *tile_mode_enter(struct state *state, struct rect area) {
         ms->sub_area_width     = ms->area.w / ms->sub_area_columns;
 
         int total_cells     = ms->sub_area_rows * ms->sub_area_columns;
-        ms->label_selection = label_selection_new(ms->label_symbols, total_cells);
+        ms->label_selection = label_selection_init(
+            arena_alloc(arena, label_selection_size(ms->label_symbols)),
+            ms->label_symbols, total_cells
+        );
+
+        // The grid is laid out as a single region.
+        struct tile_region grid = {
+            .area         = ms->area,
+            .rows         = ms->sub_area_rows,
+            .cols         = ms->sub_area_columns,
+            .cell_w       = ms->sub_area_width,
+            .cell_w_off   = ms->sub_area_width_off,
+            .cell_h       = ms->sub_area_height,
+            .cell_h_off   = ms->sub_area_height_off,
+            .label_offset = 0,
+            .num_labels   = total_cells,
+        };
+        layout_init(&ms->layout, arena, total_cells);
+        layout_region(ms, arena, label_order, &grid);
     }
 
-    ms->label_font_face = cairo_toy_font_face_create(
-        state->config.mode_tile.label_font_family, CAIRO_FONT_SLANT_NORMAL,
-        CAIRO_FONT_WEIGHT_NORMAL
+    ms->label_font_face =
+        label_font_face_create(state->config.mode_tile.label_font_family);
+    glyph_atlas_cache_init(
+        &ms->glyph_atlases, ms->label_font_face, ms->label_symbols
     );
 
     return ms;
@@ -132,23 +263,28 @@ void tile_mode_reenter(struct state *state, void *mode_state) {
     tile_mode_back(ms);
 }
 
-static struct rect
-idx_to_rect(struct tile_mode_state *mode_state, int idx, int x_off, int y_off) {
-    int column = idx / mode_state->sub_area_rows;
-    int row    = idx % mode_state->sub_area_rows;
-
+// `label_idx_to_rect` returns the cell of the label at `idx` in global
+// coordinates.
+static struct rect label_idx_to_rect(struct tile_mode_state *ms, int idx) {
     return (struct rect){
-        .x = column * mode_state->sub_area_width +
-             min(column, mode_state->sub_area_width_off) + x_off,
-        .w = mode_state->sub_area_width +
-             (column < mode_state->sub_area_width_off ? 1 : 0),
-        .y = row * mode_state->sub_area_height +
-             min(row, mode_state->sub_area_height_off) + y_off,
-        .h = mode_state->sub_area_height +
-             (row < mode_state->sub_area_height_off ? 1 : 0),
+        .x = ms->layout.x[idx],
+        .y = ms->layout.y[idx],
+        .w = ms->layout.w[idx],
+        .h = ms->layout.h[idx],
     };
 }
 
+static double label_font_size(
+    struct mode_tile_config *config, struct tile_mode_state *ms
+) {
+    // For regions use the first region's cell height, otherwise the
+    // single-output cell height.
+    int ref_cell_h = (ms->regions != NULL && ms->num_regions > 0)
+                         ? ms->regions[0].cell_h
+                         : ms->sub_area_height;
+    return compute_relative_font_size(&config->label_font_size, ref_cell_h);
+}
+
 static bool tile_mode_key(
     struct state *state, void *mode_state, xkb_keysym_t keysym, char *text
 ) {
@@ -163,7 +299,9 @@ static bool tile_mode_key(
         state->running = false;
         break;
     default:;
-        int symbol_idx = label_symbols_find_idx(ms->label_symbols, text);
+        int symbol_idx = keysym_map_find_label_symbol(
+            &ms->symbol_map, ms->label_symbols, keysym, text
+        );
         if (symbol_idx < 0) {
             return false;
         }
@@ -172,38 +310,7 @@ static bool tile_mode_key(
 
         int label_idx = label_selection_to_idx(ms->label_selection);
         if (label_idx >= 0) {
-            if (ms->regions != NULL) {
-                // Find which region this label belongs to, then compute the
-                // cell rect within that region.
-                for (int ri = 0; ri < ms->num_regions; ri++) {
-                    struct tile_region *r = &ms->regions[ri];
-                    if (label_idx < r->label_offset ||
-                        label_idx >= r->label_offset + r->num_labels) {
-                        continue;
-                    }
-                    int local = label_idx - r->label_offset;
-                    int col   = local / r->rows;
-                    int row   = local % r->rows;
-                    int x = col * r->cell_w + min(col, r->cell_w_off);
-                    int w = r->cell_w + (col < r->cell_w_off ? 1 : 0);
-                    int y = row * r->cell_h + min(row, r->cell_h_off);
-                    int h = r->cell_h + (row < r->cell_h_off ? 1 : 0);
-                    enter_next_mode(
-                        state,
-                        (struct rect){
-                            .x = r->area.x + x,
-                            .y = r->area.y + y,
-                            .w = w,
-                            .h = h,
-                        }
-                    );
-                    break;
-                }
-            } else {
-                enter_next_mode(
-                    state, idx_to_rect(ms, label_idx, ms->area.x, ms->area.y)
-                );
-            }
+            enter_next_mode(state, label_idx_to_rect(ms, label_idx));
         }
         return true;
     }
@@ -211,155 +318,202 @@ static bool tile_mode_key(
     return false;
 }
 
-// Render one selectable cell at position (x, y) with size (w, h).
-// curr_label is the label for this cell; selection is the current user input.
+// Layers of the cells, drawn one after the other so that the rects of each
+// layer are batched.
+enum cell_layer {
+    CELL_LAYER_BG,
+    CELL_LAYER_BORDER,
+    CELL_LAYER_LABEL,
+    CELL_NUM_LAYERS,
+};
+
+// Render one layer of a selectable cell. curr_label is the label for this
+// cell; selection is the current user input.
 static void render_cell(
-    struct mode_tile_config *config, cairo_t *cairo,
+    struct mode_tile_config *config, struct painter *painter,
+    struct glyph_atlas *atlas, enum cell_layer layer,
     label_selection_t *curr_label, label_selection_t *selection,
-    int x, int y, int w, int h,
-    char *label_selected_str, char *label_unselected_str
+    struct rect cell
 ) {
-    const bool selectable = label_selection_is_included(curr_label, selection);
-    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
-    if (!selectable) {
-        return;
+    switch (layer) {
+    case CELL_LAYER_BG:
+        painter_fill(
+            painter, cell, config->selectable_bg_color, CAIRO_OPERATOR_SOURCE
+        );
+        break;
+    case CELL_LAYER_BORDER:
+        painter_border(
+            painter, cell, config->selectable_border_color,
+            CAIRO_OPERATOR_SOURCE
+        );
+        break;
+    default:
+        painter_draw_label(
+            painter, atlas, curr_label, selection->next, cell,
+            config->label_select_color, config->label_color,
+            CAIRO_OPERATOR_SOURCE
+        );
+        break;
     }
+}
 
-    cairo_set_source_u32(cairo, config->selectable_bg_color);
-    cairo_rectangle(cairo, x, y, w, h);
-    cairo_fill(cairo);
-
-    cairo_set_source_u32(cairo, config->selectable_border_color);
-    cairo_rectangle(cairo, x + .5, y + .5, w - 1, h - 1);
-    cairo_set_line_width(cairo, 1);
-    cairo_stroke(cairo);
-
-    cairo_text_extents_t te_all;
-    label_selection_str(curr_label, label_selected_str);
-    cairo_text_extents(cairo, label_selected_str, &te_all);
-
-    label_selection_str_split(
-        curr_label, label_selected_str, label_unselected_str, selection->next
-    );
+// Render the cells of the labels in [from, to) that start with the selection
+// and are visible in `clip`.
+static void render_cells(
+    struct mode_tile_config *config, struct painter *painter,
+    struct glyph_atlas *atlas, struct tile_mode_state *ms,
+    label_selection_t *curr_label, double font_size, struct rect clip,
+    int from, int to
+) {
+    int first, stride;
+    label_selection_matching(ms->label_selection, &first, &stride);
+    if (first < from) {
+        first += (from - first + stride - 1) / stride * stride;
+    }
 
-    cairo_text_extents_t te_selected, te_unselected;
-    cairo_text_extents(cairo, label_selected_str, &te_selected);
-    cairo_text_extents(cairo, label_unselected_str, &te_unselected);
+    for (int layer = 0; layer < CELL_NUM_LAYERS; layer++) {
+        for (int li = first; li < to; li += stride) {
+            struct rect cell = label_idx_to_rect(ms, li);
+            if (!rect_intersects(
+                    damage_label_rect(cell, curr_label->len, font_size), clip
+                )) {
+                continue;
+            }
 
-    cairo_move_to(
-        cairo,
-        x + (w - te_selected.x_advance - te_unselected.x_advance) / 2,
-        y + (int)((h + te_all.height) / 2)
-    );
-    cairo_set_source_u32(cairo, config->label_select_color);
-    cairo_show_text(cairo, label_selected_str);
-    cairo_set_source_u32(cairo, config->label_color);
-    cairo_show_text(cairo, label_unselected_str);
+            if (layer == CELL_LAYER_LABEL) {
+                label_selection_set_from_idx(curr_label, li);
+            }
+            render_cell(
+                config, painter, atlas, layer, curr_label, ms->label_selection,
+                cell
+            );
+        }
+    }
 }
 
-void tile_mode_render(struct state *state, void *mode_state, cairo_t *cairo) {
+void tile_mode_render(
+    struct state *state, void *mode_state, cairo_t *cairo, struct rect clip
+) {
     struct mode_tile_config *config = &state->config.mode_tile;
     struct tile_mode_state  *ms     = mode_state;
 
-    // Font size: for regions use the first region's cell height, otherwise
-    // the single-output cell height.
-    int ref_cell_h = (ms->regions != NULL && ms->num_regions > 0)
-                         ? ms->regions[0].cell_h
-                         : ms->sub_area_height;
-    cairo_set_font_face(cairo, ms->label_font_face);
-    cairo_set_font_size(
-        cairo,
-        compute_relative_font_size(&config->label_font_size, ref_cell_h)
-    );
+    double              font_size = label_font_size(config, ms);
+    struct glyph_atlas *atlas =
+        glyph_atlas_cache_get(&ms->glyph_atlases, cairo, font_size);
+
+    struct painter painter;
+    painter_init(&painter, cairo, state->config.general.render_backend);
 
     // Paint background over the whole surface.
-    cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
-    cairo_set_source_u32(cairo, config->unselectable_bg_color);
-    cairo_paint(cairo);
+    painter_paint(&painter, config->unselectable_bg_color);
 
     int num_labels = ms->label_selection->num_labels;
+    _Alignas(label_selection_t) char curr_label_buf[LABEL_SELECTION_MAX_SIZE];
     label_selection_t *curr_label =
-        label_selection_new(ms->label_symbols, num_labels);
-
-    int  label_str_max_len = label_selection_str_max_len(curr_label) + 1;
-    char label_selected_str[label_str_max_len];
-    char label_unselected_str[label_str_max_len];
+        label_selection_init(curr_label_buf, ms->label_symbols, num_labels);
 
     if (ms->regions != NULL) {
-        // Region-based rendering: iterate over each monitor's region.
+        // Region-based rendering: only the monitors' regions in the clip.
         for (int ri = 0; ri < ms->num_regions; ri++) {
             struct tile_region *r = &ms->regions[ri];
+            if (!rect_intersects(r->area, clip)) {
+                continue;
+            }
 
             // Draw region outline.
-            cairo_set_source_u32(cairo, config->unselectable_bg_color);
-            cairo_rectangle(
-                cairo, r->area.x + .5, r->area.y + .5,
-                r->area.w - 1, r->area.h - 1
+            painter_border(
+                &painter, r->area, config->unselectable_bg_color,
+                CAIRO_OPERATOR_SOURCE
+            );
+
+            render_cells(
+                config, &painter, atlas, ms, curr_label, font_size, clip,
+                r->label_offset, r->label_offset + r->num_labels
             );
-            cairo_set_line_width(cairo, 1);
-            cairo_stroke(cairo);
-
-            label_selection_set_from_idx(curr_label, r->label_offset);
-
-            for (int li = 0; li < r->num_labels; li++) {
-                int col = li / r->rows;
-                int row = li % r->rows;
-                int x = r->area.x + col * r->cell_w + min(col, r->cell_w_off);
-                int w = r->cell_w + (col < r->cell_w_off ? 1 : 0);
-                int y = r->area.y + row * r->cell_h + min(row, r->cell_h_off);
-                int h = r->cell_h + (row < r->cell_h_off ? 1 : 0);
-
-                render_cell(
-                    config, cairo, curr_label, ms->label_selection,
-                    x, y, w, h, label_selected_str, label_unselected_str
-                );
-                label_selection_incr(curr_label);
-            }
         }
     } else {
         // Single-output flat grid.
-        cairo_translate(cairo, ms->area.x, ms->area.y);
+        painter_border(
+            &painter, ms->area, config->unselectable_bg_color,
+            CAIRO_OPERATOR_SOURCE
+        );
+
+        render_cells(
+            config, &painter, atlas, ms, curr_label, font_size, clip, 0,
+            num_labels
+        );
+    }
 
-        cairo_set_source_u32(cairo, config->unselectable_bg_color);
-        cairo_rectangle(cairo, .5, .5, ms->area.w - 1, ms->area.h - 1);
-        cairo_set_line_width(cairo, 1);
-        cairo_stroke(cairo);
+    painter_finish(&painter);
+    glyph_atlas_release(&ms->glyph_atlases, atlas);
+}
 
-        label_selection_set_from_idx(curr_label, 0);
+static void
+tile_mode_damage(struct state *state, void *mode_state, struct damage *damage) {
+    struct mode_tile_config *config = &state->config.mode_tile;
+    struct tile_mode_state  *ms     = mode_state;
 
-        for (int li = 0; li < num_labels; li++) {
-            int column = li / ms->sub_area_rows;
-            int row    = li % ms->sub_area_rows;
+    double font_size  = label_font_size(config, ms);
+    int    num_labels = ms->label_selection->num_labels;
+    int    label_len  = ms->label_selection->len;
+
+    int first, stride;
+    label_selection_matching(ms->label_selection, &first, &stride);
+    for (int li = first; li < num_labels; li += stride) {
+        damage_add(
+            damage,
+            damage_label_rect(label_idx_to_rect(ms, li), label_len, font_size)
+        );
+    }
+}
 
-            int x = column * ms->sub_area_width +
-                    min(column, ms->sub_area_width_off);
-            int w = ms->sub_area_width +
-                    (column < ms->sub_area_width_off ? 1 : 0);
-            int y =
-                row * ms->sub_area_height + min(row, ms->sub_area_height_off);
-            int h = ms->sub_area_height +
-                    (row < ms->sub_area_height_off ? 1 : 0);
+static struct rect tile_mode_content_bounds(
+    struct state *state, void *mode_state, uint32_t *bg_color
+) {
+    // Everything but the matching labels is the background.
+    struct damage damage;
+    damage_clear(&damage);
+    tile_mode_damage(state, mode_state, &damage);
 
-            render_cell(
-                config, cairo, curr_label, ms->label_selection,
-                x, y, w, h, label_selected_str, label_unselected_str
-            );
-            label_selection_incr(curr_label);
-        }
+    *bg_color = state->config.mode_tile.unselectable_bg_color;
+    return damage_extents(&damage);
+}
+
+static int tile_mode_num_candidates(struct state *state, void *mode_state) {
+    struct tile_mode_state *ms = mode_state;
+    return ms->label_symbols->num_symbols;
+}
+
+static bool
+tile_mode_select_candidate(struct state *state, void *mode_state, int i) {
+    struct tile_mode_state *ms        = mode_state;
+    label_selection_t      *selection = ms->label_selection;
 
-        cairo_translate(cairo, -ms->area.x, -ms->area.y);
+    if (i < 0) {
+        return label_selection_back(selection);
     }
 
-    label_selection_free(curr_label);
+    if (selection->next + 1 >= selection->len) {
+        // Completing a label enters the next mode.
+        return false;
+    }
+
+    return label_selection_append(selection, i) ==
+           LABEL_SELECTION_APPEND_SUCCESS;
+}
+
+static uint64_t tile_mode_frame_id(struct state *state, void *mode_state) {
+    struct tile_mode_state *ms        = mode_state;
+    label_selection_t      *selection = ms->label_selection;
+
+    uint64_t id = fnv1a(FNV1A_INIT, &selection->next, sizeof(selection->next));
+    return fnv1a(id, selection->input, selection->next);
 }
 
 void tile_mode_state_free(void *mode_state) {
     struct tile_mode_state *ms = mode_state;
+    glyph_atlas_cache_free(&ms->glyph_atlases);
     cairo_font_face_destroy(ms->label_font_face);
-    label_selection_free(ms->label_selection);
-    label_symbols_free(ms->label_symbols);
-    free(ms->regions);
-    free(ms);
 }
 
 struct mode_interface tile_mode_interface = {
@@ -369,4 +523,10 @@ struct mode_interface tile_mode_interface = {
     .key     = tile_mode_key,
     .render  = tile_mode_render,
     .free    = tile_mode_state_free,
+    .damage  = tile_mode_damage,
+
+    .content_bounds   = tile_mode_content_bounds,
+    .num_candidates   = tile_mode_num_candidates,
+    .select_candidate = tile_mode_select_candidate,
+    .frame_id         = tile_mode_frame_id,
 };
@@ -0,0 +1,363 @@
+#include "painter.h"
+
+#include "utils_cairo.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#if PIXMAN_ENABLED
+
+static pixman_color_t to_pixman_color(uint32_t color) {
+    // Premultiplied 16-bit components.
+    uint32_t a = color & 0xff;
+    return (pixman_color_t){
+        .red   = (color >> 24 & 0xff) * a * 0x101 / 0xff,
+        .green = (color >> 16 & 0xff) * a * 0x101 / 0xff,
+        .blue  = (color >> 8 & 0xff) * a * 0x101 / 0xff,
+        .alpha = a * 0x101,
+    };
+}
+
+static pixman_op_t to_pixman_op(cairo_operator_t op) {
+    return op == CAIRO_OPERATOR_SOURCE ? PIXMAN_OP_SRC : PIXMAN_OP_OVER;
+}
+
+// Smallest box of whole pixels of the target covering the rect in user space.
+static pixman_box32_t to_pixman_box(
+    struct painter *painter, double x, double y, double w, double h
+) {
+    return (pixman_box32_t){
+        .x1 = round(x * painter->scale_x + painter->offset_x),
+        .y1 = round(y * painter->scale_y + painter->offset_y),
+        .x2 = round((x + w) * painter->scale_x + painter->offset_x),
+        .y2 = round((y + h) * painter->scale_y + painter->offset_y),
+    };
+}
+
+/**
+ * `create_target_image` wraps the context's target in a pixman image with the
+ * context's clip. Returns NULL when the target or the clip can't be drawn in
+ * with pixman.
+ */
+static pixman_image_t *create_target_image(struct painter *painter) {
+    cairo_t         *cairo  = painter->cairo;
+    cairo_surface_t *target = cairo_get_target(cairo);
+
+    cairo_matrix_t matrix;
+    cairo_get_matrix(cairo, &matrix);
+    if (cairo_surface_get_type(target) != CAIRO_SURFACE_TYPE_IMAGE ||
+        cairo_image_surface_get_format(target) != CAIRO_FORMAT_ARGB32 ||
+        matrix.xy != 0 || matrix.yx != 0) {
+        return NULL;
+    }
+
+    cairo_rectangle_list_t *clip = cairo_copy_clip_rectangle_list(cairo);
+    if (clip->status != CAIRO_STATUS_SUCCESS) {
+        cairo_rectangle_list_destroy(clip);
+        return NULL;
+    }
+
+    double device_x, device_y;
+    cairo_surface_get_device_offset(target, &device_x, &device_y);
+    painter->device_x = device_x;
+    painter->device_y = device_y;
+    painter->scale_x  = matrix.xx;
+    painter->scale_y  = matrix.yy;
+    painter->offset_x = matrix.x0 + device_x;
+    painter->offset_y = matrix.y0 + device_y;
+
+    cairo_surface_flush(target);
+    pixman_image_t *image = pixman_image_create_bits(
+        PIXMAN_a8r8g8b8, cairo_image_surface_get_width(target),
+        cairo_image_surface_get_height(target),
+        (uint32_t *)cairo_image_surface_get_data(target),
+        cairo_image_surface_get_stride(target)
+    );
+
+    // The clip is in user space.
+    pixman_box32_t boxes[clip->num_rectangles + 1];
+    for (int i = 0; i < clip->num_rectangles; i++) {
+        cairo_rectangle_t *r = &clip->rectangles[i];
+        boxes[i] = to_pixman_box(painter, r->x, r->y, r->width, r->height);
+    }
+
+    pixman_region32_t region;
+    pixman_region32_init_rects(&region, boxes, clip->num_rectangles);
+    pixman_image_set_clip_region32(image, &region);
+    pixman_region32_fini(&region);
+
+    cairo_rectangle_list_destroy(clip);
+    return image;
+}
+
+static pixman_image_t *solid_image(struct painter *painter, uint32_t color) {
+    if (painter->solid != NULL && painter->solid_color == color) {
+        return painter->solid;
+    }
+
+    if (painter->solid != NULL) {
+        pixman_image_unref(painter->solid);
+    }
+
+    pixman_color_t pixman_color = to_pixman_color(color);
+    painter->solid              = pixman_image_create_solid_fill(&pixman_color);
+    painter->solid_color        = color;
+    return painter->solid;
+}
+
+static pixman_image_t *
+atlas_image(struct painter *painter, struct glyph_atlas *atlas) {
+    if (painter->atlas == atlas) {
+        return painter->atlas_image;
+    }
+
+    if (painter->atlas_image != NULL) {
+        pixman_image_unref(painter->atlas_image);
+    }
+
+    painter->atlas       = atlas;
+    painter->atlas_image = pixman_image_create_bits(
+        PIXMAN_a8, cairo_image_surface_get_width(atlas->surface),
+        cairo_image_surface_get_height(atlas->surface),
+        (uint32_t *)cairo_image_surface_get_data(atlas->surface),
+        cairo_image_surface_get_stride(atlas->surface)
+    );
+    return painter->atlas_image;
+}
+
+static void flush_pixman_batch(struct painter *painter) {
+    pixman_box32_t boxes[PAINTER_MAX_BATCH * 4];
+    int            num_boxes = 0;
+
+    for (int i = 0; i < painter->num_rects; i++) {
+        struct rect    r   = painter->rects[i];
+        pixman_box32_t box = to_pixman_box(painter, r.x, r.y, r.w, r.h);
+
+        int border_w = max(round(painter->scale_x), 1);
+        int border_h = max(round(painter->scale_y), 1);
+        if (painter->batch == PAINTER_BATCH_FILL ||
+            box.x2 - box.x1 <= 2 * border_w ||
+            box.y2 - box.y1 <= 2 * border_h) {
+            boxes[num_boxes++] = box;
+            continue;
+        }
+
+        // The border's sides, without overlapping for translucent colors.
+        int x1 = box.x1, y1 = box.y1, x2 = box.x2, y2 = box.y2;
+        boxes[num_boxes++] = (pixman_box32_t){x1, y1, x2, y1 + border_h};
+        boxes[num_boxes++] = (pixman_box32_t){x1, y2 - border_h, x2, y2};
+        boxes[num_boxes++] =
+            (pixman_box32_t){x1, y1 + border_h, x1 + border_w, y2 - border_h};
+        boxes[num_boxes++] =
+            (pixman_box32_t){x2 - border_w, y1 + border_h, x2, y2 - border_h};
+    }
+
+    pixman_color_t color = to_pixman_color(painter->color);
+    pixman_image_fill_boxes(
+        to_pixman_op(painter->op), painter->image, &color, num_boxes, boxes
+    );
+}
+
+static void draw_pixman_label(
+    struct painter *painter, struct glyph_atlas *atlas,
+    label_selection_t *label, int cut, struct rect rect,
+    uint32_t selected_color, uint32_t color, cairo_operator_t op
+) {
+    double x;
+    int    pen_y;
+    glyph_atlas_label_origin(atlas, painter->cairo, label, rect, &x, &pen_y);
+
+    pixman_image_t *mask = atlas_image(painter, atlas);
+    for (int i = 0; i < label->next; i++) {
+        uint32_t      glyph_color = i < cut ? selected_color : color;
+        struct glyph *glyph       = &atlas->glyphs[label->input[i]];
+        struct rect   src         = glyph->mask_rect;
+        int dst_x = round(x) + glyph->mask_x + painter->device_x;
+        int dst_y = pen_y + glyph->mask_y + painter->device_y;
+        x        += glyph->x_advance;
+
+        if (op == CAIRO_OPERATOR_SOURCE && (glyph_color & 0xff) != 0xff) {
+            if (painter->opaque == NULL) {
+                pixman_color_t black = {.alpha = 0xffff};
+                painter->opaque = pixman_image_create_solid_fill(&black);
+            }
+
+            // Like cairo, the mask interpolates between the destination and
+            // the source: clear under it and add the source.
+            pixman_image_composite32(
+                PIXMAN_OP_OUT_REVERSE, painter->opaque, mask,
+                painter->image, 0, 0, src.x, src.y, dst_x, dst_y, src.w, src.h
+            );
+            pixman_image_composite32(
+                PIXMAN_OP_ADD, solid_image(painter, glyph_color), mask,
+                painter->image, 0, 0, src.x, src.y, dst_x, dst_y, src.w, src.h
+            );
+        } else {
+            pixman_image_composite32(
+                PIXMAN_OP_OVER, solid_image(painter, glyph_color), mask,
+                painter->image, 0, 0, src.x, src.y, dst_x, dst_y, src.w, src.h
+            );
+        }
+    }
+}
+
+#endif
+
+void painter_init(
+    struct painter *painter, cairo_t *cairo, enum render_backend backend
+) {
+    painter->cairo     = cairo;
+    painter->batch     = PAINTER_BATCH_NONE;
+    painter->num_rects = 0;
+
+#if PIXMAN_ENABLED
+    painter->image       = NULL;
+    painter->solid       = NULL;
+    painter->opaque      = NULL;
+    painter->atlas       = NULL;
+    painter->atlas_image = NULL;
+    if (backend == RENDER_BACKEND_PIXMAN) {
+        painter->image = create_target_image(painter);
+    }
+#endif
+}
+
+static void flush_batch(struct painter *painter) {
+    if (painter->num_rects == 0) {
+        return;
+    }
+
+#if PIXMAN_ENABLED
+    if (painter->image != NULL) {
+        flush_pixman_batch(painter);
+        painter->num_rects = 0;
+        return;
+    }
+#endif
+
+    cairo_t *cairo = painter->cairo;
+    for (int i = 0; i < painter->num_rects; i++) {
+        struct rect r = painter->rects[i];
+        if (painter->batch == PAINTER_BATCH_BORDER) {
+            cairo_rectangle(cairo, r.x + .5, r.y + .5, r.w - 1, r.h - 1);
+        } else {
+            cairo_rectangle(cairo, r.x, r.y, r.w, r.h);
+        }
+    }
+
+    cairo_set_operator(cairo, painter->op);
+    cairo_set_source_u32(cairo, painter->color);
+    if (painter->batch == PAINTER_BATCH_BORDER) {
+        cairo_set_line_width(cairo, 1);
+        cairo_stroke(cairo);
+    } else {
+        cairo_fill(cairo);
+    }
+
+    painter->num_rects = 0;
+}
+
+void painter_flush(struct painter *painter) {
+    flush_batch(painter);
+
+#if PIXMAN_ENABLED
+    if (painter->image != NULL) {
+        cairo_surface_mark_dirty(cairo_get_target(painter->cairo));
+    }
+#endif
+}
+
+void painter_finish(struct painter *painter) {
+    painter_flush(painter);
+
+#if PIXMAN_ENABLED
+    if (painter->image != NULL) {
+        pixman_image_unref(painter->image);
+    }
+    if (painter->solid != NULL) {
+        pixman_image_unref(painter->solid);
+    }
+    if (painter->opaque != NULL) {
+        pixman_image_unref(painter->opaque);
+    }
+    if (painter->atlas_image != NULL) {
+        pixman_image_unref(painter->atlas_image);
+    }
+#endif
+}
+
+static void add_rect(
+    struct painter *painter, enum painter_batch batch, struct rect rect,
+    uint32_t color, cairo_operator_t op
+) {
+    if (painter->batch != batch || painter->color != color ||
+        painter->op != op || painter->num_rects == PAINTER_MAX_BATCH) {
+        flush_batch(painter);
+        painter->batch = batch;
+        painter->color = color;
+        painter->op    = op;
+    }
+
+    painter->rects[painter->num_rects++] = rect;
+}
+
+void painter_paint(struct painter *painter, uint32_t color) {
+    flush_batch(painter);
+
+#if PIXMAN_ENABLED
+    if (painter->image != NULL) {
+        // The image's clip limits the fill.
+        pixman_box32_t box = {
+            .x1 = 0,
+            .y1 = 0,
+            .x2 = pixman_image_get_width(painter->image),
+            .y2 = pixman_image_get_height(painter->image),
+        };
+        pixman_color_t pixman_color = to_pixman_color(color);
+        pixman_image_fill_boxes(
+            PIXMAN_OP_SRC, painter->image, &pixman_color, 1, &box
+        );
+        return;
+    }
+#endif
+
+    cairo_set_operator(painter->cairo, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_u32(painter->cairo, color);
+    cairo_paint(painter->cairo);
+}
+
+void painter_fill(
+    struct painter *painter, struct rect rect, uint32_t color,
+    cairo_operator_t op
+) {
+    add_rect(painter, PAINTER_BATCH_FILL, rect, color, op);
+}
+
+void painter_border(
+    struct painter *painter, struct rect rect, uint32_t color,
+    cairo_operator_t op
+) {
+    add_rect(painter, PAINTER_BATCH_BORDER, rect, color, op);
+}
+
+void painter_draw_label(
+    struct painter *painter, struct glyph_atlas *atlas,
+    label_selection_t *label, int cut, struct rect rect,
+    uint32_t selected_color, uint32_t color, cairo_operator_t op
+) {
+    flush_batch(painter);
+
+#if PIXMAN_ENABLED
+    if (painter->image != NULL) {
+        draw_pixman_label(
+            painter, atlas, label, cut, rect, selected_color, color, op
+        );
+        return;
+    }
+#endif
+
+    cairo_set_operator(painter->cairo, op);
+    glyph_atlas_draw_label(
+        atlas, painter->cairo, label, cut, rect, selected_color, color
+    );
+}
@@ -0,0 +1,91 @@
+#ifndef __PAINTER_H_INCLUDED__
+#define __PAINTER_H_INCLUDED__
+
+#include "config.h"
+#include "glyph_atlas.h"
+#include "label.h"
+#include "utils.h"
+
+#include <cairo.h>
+#include <stdint.h>
+
+#if PIXMAN_ENABLED
+#include <pixman.h>
+#endif
+
+#define PAINTER_MAX_BATCH 256
+
+enum painter_batch {
+    PAINTER_BATCH_NONE,
+    PAINTER_BATCH_FILL,
+    PAINTER_BATCH_BORDER,
+};
+
+/**
+ * Paints the axis-aligned rects, borders and labels the modes are made of in
+ * a cairo context. Consecutive rects of the same kind and color are batched.
+ *
+ * With the pixman backend, they are filled and composited directly in the
+ * context's target, on whole device pixels, instead of going through cairo's
+ * path machinery. The batch must be flushed with `painter_flush` before
+ * drawing in the context with cairo.
+ */
+struct painter {
+    cairo_t *cairo;
+
+#if PIXMAN_ENABLED
+    pixman_image_t *image; // the context's target, NULL to use cairo
+
+    // From user space to the target's pixels.
+    double scale_x;
+    double scale_y;
+    double offset_x;
+    double offset_y;
+    int    device_x; // the target's device offset
+    int    device_y;
+
+    pixman_image_t     *solid;  // of `solid_color`
+    pixman_image_t     *opaque; // to clear under masks
+    uint32_t            solid_color;
+    pixman_image_t     *atlas_image; // of `atlas`
+    struct glyph_atlas *atlas;
+#endif
+
+    enum painter_batch batch;
+    uint32_t           color;
+    cairo_operator_t   op;
+    int                num_rects;
+    struct rect        rects[PAINTER_MAX_BATCH];
+};
+
+void painter_init(
+    struct painter *painter, cairo_t *cairo, enum render_backend backend
+);
+
+// Flushes the batch and frees the painter's resources.
+void painter_finish(struct painter *painter);
+
+void painter_flush(struct painter *painter);
+
+// Paints the whole clip with the `SOURCE` operator.
+void painter_paint(struct painter *painter, uint32_t color);
+
+void painter_fill(
+    struct painter *painter, struct rect rect, uint32_t color,
+    cairo_operator_t op
+);
+
+// Paints a border one unit wide inside `rect`.
+void painter_border(
+    struct painter *painter, struct rect rect, uint32_t color,
+    cairo_operator_t op
+);
+
+// Same as `glyph_atlas_draw_label` with the `op` operator.
+void painter_draw_label(
+    struct painter *painter, struct glyph_atlas *atlas,
+    label_selection_t *label, int cut, struct rect rect,
+    uint32_t selected_color, uint32_t color, cairo_operator_t op
+);
+
+#endif
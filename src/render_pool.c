@@ -0,0 +1,102 @@
+#include "render_pool.h"
+
+#include "log.h"
+
+#include <string.h>
+
+/**
+ * `run_next_job` runs the next job, if any, with the pool's mutex held around
+ * it. Returns false when there are no jobs left to start.
+ */
+static bool run_next_job(struct render_pool *pool) {
+    if (pool->next_job >= pool->num_jobs) {
+        return false;
+    }
+
+    int i = pool->next_job++;
+    pthread_mutex_unlock(&pool->mutex);
+    pool->fn(pool->data, i);
+    pthread_mutex_lock(&pool->mutex);
+
+    if (--pool->pending_jobs == 0) {
+        pthread_cond_signal(&pool->done_cond);
+    }
+    return true;
+}
+
+static void *worker_main(void *data) {
+    struct render_pool *pool = data;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->stopping) {
+        if (!run_next_job(pool)) {
+            pthread_cond_wait(&pool->jobs_cond, &pool->mutex);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+void render_pool_init(struct render_pool *pool, int num_threads) {
+    memset(pool, 0, sizeof(struct render_pool));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->jobs_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    if (num_threads > RENDER_POOL_MAX_THREADS) {
+        num_threads = RENDER_POOL_MAX_THREADS;
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            LOG_WARN("Could not start render thread, using %d.", i);
+            break;
+        }
+        pool->num_threads++;
+    }
+}
+
+void render_pool_finish(struct render_pool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->jobs_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->jobs_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    pool->num_threads = 0;
+}
+
+void render_pool_run(
+    struct render_pool *pool, render_pool_job_fn fn, void *data, int num_jobs
+) {
+    if (pool->num_threads == 0 || num_jobs <= 1) {
+        for (int i = 0; i < num_jobs; i++) {
+            fn(data, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->fn           = fn;
+    pool->data         = data;
+    pool->num_jobs     = num_jobs;
+    pool->next_job     = 0;
+    pool->pending_jobs = num_jobs;
+    pthread_cond_broadcast(&pool->jobs_cond);
+
+    while (run_next_job(pool)) {}
+    while (pool->pending_jobs > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+
+    pool->num_jobs = 0;
+    pool->next_job = 0;
+    pthread_mutex_unlock(&pool->mutex);
+}
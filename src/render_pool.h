@@ -0,0 +1,46 @@
+#ifndef __RENDER_POOL_H_INCLUDED__
+#define __RENDER_POOL_H_INCLUDED__
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#define RENDER_POOL_MAX_THREADS 15
+
+typedef void (*render_pool_job_fn)(void *data, int i);
+
+/**
+ * A small pool of worker threads rendering independent jobs, e.g. overlays or
+ * bands of a frame. The thread submitting the jobs takes part in running them.
+ */
+struct render_pool {
+    pthread_mutex_t mutex;
+    pthread_cond_t  jobs_cond; // new jobs or stopping
+    pthread_cond_t  done_cond; // all the jobs are done
+
+    int       num_threads;
+    pthread_t threads[RENDER_POOL_MAX_THREADS];
+    bool      stopping;
+
+    render_pool_job_fn fn;
+    void              *data;
+    int                num_jobs;
+    int                next_job;
+    int                pending_jobs; // submitted but not done yet
+};
+
+/**
+ * `render_pool_init` starts up to `num_threads` workers. With none, the jobs
+ * run on the submitting thread.
+ */
+void render_pool_init(struct render_pool *pool, int num_threads);
+void render_pool_finish(struct render_pool *pool);
+
+/**
+ * `render_pool_run` calls `fn(data, i)` for each `i` in `[0, num_jobs)`
+ * concurrently and returns when all the calls are done.
+ */
+void render_pool_run(
+    struct render_pool *pool, render_pool_job_fn fn, void *data, int num_jobs
+);
+
+#endif
@@ -4,14 +4,11 @@
 
 #include "log.h"
 #include "state.h"
-#include "surface_buffer.h"
+#include "trace.h"
 #include "wlr-screencopy-unstable-v1-client-protocol.h"
 
-#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/mman.h>
-#include <unistd.h>
 
 enum screen_capture_state {
     CAPTURE_NOT_REQUESTED,
@@ -31,46 +28,37 @@ static struct scrcpy_buffer *create_scrcpy_buffer(
     struct wl_shm *shm, enum wl_shm_format format, uint32_t width,
     uint32_t height, uint32_t stride
 ) {
-    size_t size = stride * height;
-
-    int fd = allocate_shm_file(size);
-    if (fd == -1) {
-        LOG_ERR("Could not allocate SHM file.");
-        return NULL;
-    }
+    struct scrcpy_buffer *buffer = malloc(sizeof(*buffer));
+    shm_pool_init(&buffer->shm, false);
 
-    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (data == MAP_FAILED) {
-        LOG_ERR("Could not mmap shared buffer for surface buffer.");
+    void   *data;
+    ssize_t offset =
+        shm_pool_alloc(&buffer->shm, shm, stride * height, &data);
+    if (offset < 0) {
+        LOG_ERR("Could not allocate SHM buffer.");
 
-        close(fd);
+        shm_pool_finish(&buffer->shm);
+        free(buffer);
         return NULL;
     }
 
-    struct wl_shm_pool *wl_shm_pool = wl_shm_create_pool(shm, fd, size);
-    struct wl_buffer   *wl_buffer   = wl_shm_pool_create_buffer(
-        wl_shm_pool, 0, width, height, stride, format
+    buffer->wl_buffer = wl_shm_pool_create_buffer(
+        buffer->shm.wl_shm_pool, offset, width, height, stride, format
     );
-    wl_shm_pool_destroy(wl_shm_pool);
-
-    close(fd);
-
-    struct scrcpy_buffer *buffer = malloc(sizeof(*buffer));
-
-    buffer->wl_buffer = wl_buffer;
-    buffer->format    = format;
-    buffer->data      = data;
-    buffer->width     = width;
-    buffer->height    = height;
-    buffer->stride    = stride;
+    buffer->format = format;
+    buffer->data   = data;
+    buffer->width  = width;
+    buffer->height = height;
+    buffer->stride = stride;
 
     return buffer;
 }
 
 void destroy_scrcpy_buffer(struct scrcpy_buffer *buf) {
     if (buf != NULL) {
-        munmap(buf->data, buf->stride * buf->height);
         wl_buffer_destroy(buf->wl_buffer);
+        shm_pool_free(&buf->shm, 0, buf->data);
+        shm_pool_finish(&buf->shm);
         free(buf);
     }
 }
@@ -124,6 +112,7 @@ struct scrcpy_buffer *
 query_screenshot(struct state *state, struct rect region) {
     struct scrcpy_state scrcpy_state;
     scrcpy_state.wl_shm = state->wl_shm;
+    TRACE_BEGIN(start);
 
     if (state->wl_screencopy_manager == NULL) {
         LOG_ERR("Could not load `zwlr_screencopy_manager_v1`.");
@@ -134,24 +123,50 @@ query_screenshot(struct state *state, struct rect region) {
         "Capture region: %dx%d+%d+%d", region.w, region.h, region.x, region.y
     );
 
+    // The capture is requested while a mode is being entered, from a Wayland
+    // event handler. Only the frame's events are dispatched meanwhile, the
+    // others are left queued until the mode is entered.
+    struct wl_event_queue *queue = wl_display_create_queue(state->wl_display);
+    struct zwlr_screencopy_manager_v1 *manager =
+        wl_proxy_create_wrapper(state->wl_screencopy_manager);
+    wl_proxy_set_queue((struct wl_proxy *)manager, queue);
+
     scrcpy_state.wl_screencopy_frame =
         zwlr_screencopy_manager_v1_capture_output_region(
-            state->wl_screencopy_manager, false,
-            state->current_output->wl_output, region.x, region.y, region.w,
-            region.h
+            manager, false, state->current_output->wl_output, region.x,
+            region.y, region.w, region.h
         );
+    wl_proxy_wrapper_destroy(manager);
     zwlr_screencopy_frame_v1_add_listener(
         scrcpy_state.wl_screencopy_frame, &screencopy_frame_listener,
         &scrcpy_state
     );
 
+    // Wait for the frame itself rather than for a round trip per event. A
+    // termination signal or a lost connection ends the session instead.
+    scrcpy_state.scrcpy_buffer        = NULL;
     scrcpy_state.screen_capture_state = CAPTURE_REQUESTED;
     while (scrcpy_state.screen_capture_state == CAPTURE_REQUESTED) {
-        wl_display_roundtrip(state->wl_display);
+        if (state->event_loop.terminated) {
+            scrcpy_state.screen_capture_state = CAPTURE_FAILED;
+            state->running                    = false;
+        } else if (event_loop_dispatch_queue(&state->event_loop, queue) < 0) {
+            LOG_ERR("Lost connection while capturing screen.");
+            scrcpy_state.screen_capture_state = CAPTURE_FAILED;
+            state->running                    = false;
+        }
     }
 
     zwlr_screencopy_frame_v1_destroy(scrcpy_state.wl_screencopy_frame);
+    wl_event_queue_destroy(queue);
+
+    if (scrcpy_state.screen_capture_state != CAPTURE_SUCCESS &&
+        scrcpy_state.scrcpy_buffer != NULL) {
+        destroy_scrcpy_buffer(scrcpy_state.scrcpy_buffer);
+        scrcpy_state.scrcpy_buffer = NULL;
+    }
 
+    TRACE_END("query_screenshot", start);
     return scrcpy_state.scrcpy_buffer;
 }
 
@@ -3,9 +3,12 @@
 
 #if OPENCV_ENABLED
 
+#include "shm_pool.h"
+
 #include <wayland-client.h>
 
 struct scrcpy_buffer {
+    struct shm_pool    shm;
     struct wl_buffer  *wl_buffer;
     void              *data;
     enum wl_shm_format format;
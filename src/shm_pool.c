@@ -0,0 +1,157 @@
+#include "shm_pool.h"
+
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static int create_memfd(void) {
+    int fd = memfd_create("wl-kbptr-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return -1;
+    }
+
+    // The pool only ever grows so the compositor can rely on its mappings.
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL);
+    return fd;
+}
+
+static int create_shm_file(void) {
+    char name[] = "/tmp/wl-shm-XXXXXX";
+    int  fd     = mkostemp(name, O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    unlink(name);
+    return fd;
+}
+
+static size_t page_align(size_t size) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+static int shm_pool_grow(
+    struct shm_pool *pool, struct wl_shm *wl_shm, size_t min_size
+) {
+    size_t size = min_size > pool->size * 2 ? min_size : pool->size * 2;
+
+    if (pool->fd < 0) {
+        pool->fd = create_memfd();
+        if (pool->fd < 0) {
+            LOG_DEBUG("Could not create memfd, falling back to a tmp file.");
+            pool->fd = create_shm_file();
+        }
+
+        if (pool->fd < 0) {
+            LOG_ERR("Could not create SHM file.");
+            return 1;
+        }
+    }
+
+    int err;
+    while ((err = ftruncate(pool->fd, size)) && errno == EINTR) {}
+    if (err) {
+        LOG_ERR("Could not resize SHM file to %zu bytes.", size);
+        return 1;
+    }
+
+    if (pool->wl_shm_pool == NULL) {
+        pool->wl_shm_pool = wl_shm_create_pool(wl_shm, pool->fd, size);
+    } else {
+        wl_shm_pool_resize(pool->wl_shm_pool, size);
+    }
+
+    pool->size = size;
+    return 0;
+}
+
+void shm_pool_init(struct shm_pool *pool, bool prefault) {
+    memset(pool, 0, sizeof(struct shm_pool));
+    pool->fd       = -1;
+    pool->prefault = prefault;
+}
+
+void shm_pool_finish(struct shm_pool *pool) {
+    if (pool->wl_shm_pool != NULL) {
+        wl_shm_pool_destroy(pool->wl_shm_pool);
+    }
+
+    if (pool->fd >= 0) {
+        close(pool->fd);
+    }
+
+    shm_pool_init(pool, pool->prefault);
+}
+
+ssize_t shm_pool_alloc(
+    struct shm_pool *pool, struct wl_shm *wl_shm, size_t size, void **data
+) {
+    if (pool->num_ranges == SHM_POOL_MAX_RANGES) {
+        LOG_ERR("Too many allocations in SHM pool.");
+        return -1;
+    }
+
+    size = page_align(size);
+
+    // First fit between the allocated ranges.
+    size_t offset = 0;
+    int    i;
+    for (i = 0; i < pool->num_ranges; i++) {
+        if (pool->ranges[i].offset - offset >= size) {
+            break;
+        }
+
+        offset = pool->ranges[i].offset + pool->ranges[i].size;
+    }
+
+    if (offset + size > pool->size &&
+        shm_pool_grow(pool, wl_shm, offset + size)) {
+        return -1;
+    }
+
+    int flags = MAP_SHARED | (pool->prefault ? MAP_POPULATE : 0);
+    *data = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, pool->fd, offset);
+    if (*data == MAP_FAILED) {
+        LOG_ERR("Could not mmap SHM pool range.");
+        *data = NULL;
+        return -1;
+    }
+
+    memmove(
+        &pool->ranges[i + 1], &pool->ranges[i],
+        (pool->num_ranges - i) * sizeof(struct shm_pool_range)
+    );
+    pool->ranges[i] = (struct shm_pool_range){.offset = offset, .size = size};
+    pool->num_ranges++;
+
+    return offset;
+}
+
+void shm_pool_free(struct shm_pool *pool, size_t offset, void *data) {
+    for (int i = 0; i < pool->num_ranges; i++) {
+        if (pool->ranges[i].offset != offset) {
+            continue;
+        }
+
+        munmap(data, pool->ranges[i].size);
+
+        // Give the pages back as the file itself never shrinks.
+        fallocate(
+            pool->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            pool->ranges[i].offset, pool->ranges[i].size
+        );
+
+        pool->num_ranges--;
+        memmove(
+            &pool->ranges[i], &pool->ranges[i + 1],
+            (pool->num_ranges - i) * sizeof(struct shm_pool_range)
+        );
+        return;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef __SHM_POOL_H_INCLUDED__
+#define __SHM_POOL_H_INCLUDED__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <wayland-client.h>
+
+#define SHM_POOL_MAX_RANGES 8
+
+struct shm_pool_range {
+    size_t offset;
+    size_t size;
+};
+
+/**
+ * A shared memory pool backed by a single file, preferably a sealed memfd,
+ * from which buffers are sub-allocated. The pool grows geometrically as
+ * needed and never shrinks. Each allocation is mapped separately so growing
+ * the pool doesn't move existing buffers.
+ */
+struct shm_pool {
+    struct wl_shm_pool *wl_shm_pool; // NULL until the first allocation
+    int                 fd;
+    size_t              size;
+    bool                prefault; // map allocations with `MAP_POPULATE`
+
+    // Allocated ranges sorted by offset.
+    int                   num_ranges;
+    struct shm_pool_range ranges[SHM_POOL_MAX_RANGES];
+};
+
+void shm_pool_init(struct shm_pool *pool, bool prefault);
+void shm_pool_finish(struct shm_pool *pool);
+
+/**
+ * `shm_pool_alloc` allocates `size` bytes in the pool and maps them in `data`.
+ * Returns the allocation's offset in the pool or a value < 0 upon error.
+ */
+ssize_t shm_pool_alloc(
+    struct shm_pool *pool, struct wl_shm *wl_shm, size_t size, void **data
+);
+
+void shm_pool_free(struct shm_pool *pool, size_t offset, void *data);
+
+#endif
@@ -0,0 +1,98 @@
+#include "solid_buffer.h"
+
+#include "log.h"
+
+#include <string.h>
+
+void solid_buffer_cache_init(
+    struct solid_buffer_cache                *cache,
+    struct wp_single_pixel_buffer_manager_v1 *single_pixel_buffer_mgr,
+    struct wl_shm                            *wl_shm
+) {
+    memset(cache, 0, sizeof(struct solid_buffer_cache));
+    cache->single_pixel_buffer_mgr = single_pixel_buffer_mgr;
+    cache->wl_shm                  = wl_shm;
+    cache->shm_offset              = -1;
+    shm_pool_init(&cache->shm, false);
+}
+
+void solid_buffer_cache_finish(struct solid_buffer_cache *cache) {
+    for (int i = 0; i < cache->num_buffers; i++) {
+        wl_buffer_destroy(cache->buffers[i].wl_buffer);
+    }
+
+    if (cache->shm_offset >= 0) {
+        shm_pool_free(&cache->shm, cache->shm_offset, cache->shm_data);
+    }
+    shm_pool_finish(&cache->shm);
+
+    cache->num_buffers = 0;
+    cache->shm_offset  = -1;
+}
+
+// Color component scaled by the alpha, as buffers use pre-multiplied alpha.
+static uint8_t premultiply(uint32_t color, int shift) {
+    uint32_t alpha = color & 0xff;
+    return ((color >> shift & 0xff) * alpha + 127) / 255;
+}
+
+static struct wl_buffer *
+create_shm_buffer(struct solid_buffer_cache *cache, uint32_t color) {
+    if (cache->shm_offset < 0) {
+        void *data;
+        cache->shm_offset = shm_pool_alloc(
+            &cache->shm, cache->wl_shm,
+            SOLID_BUFFER_CACHE_SIZE * sizeof(uint32_t), &data
+        );
+        if (cache->shm_offset < 0) {
+            return NULL;
+        }
+        cache->shm_data = data;
+    }
+
+    int idx = cache->num_buffers;
+    cache->shm_data[idx] = (color & 0xff) << 24 | premultiply(color, 24) << 16 |
+                           premultiply(color, 16) << 8 | premultiply(color, 8);
+
+    return wl_shm_pool_create_buffer(
+        cache->shm.wl_shm_pool, cache->shm_offset + idx * sizeof(uint32_t), 1,
+        1, sizeof(uint32_t), WL_SHM_FORMAT_ARGB8888
+    );
+}
+
+struct wl_buffer *
+solid_buffer_cache_get(struct solid_buffer_cache *cache, uint32_t color) {
+    for (int i = 0; i < cache->num_buffers; i++) {
+        if (cache->buffers[i].color == color) {
+            return cache->buffers[i].wl_buffer;
+        }
+    }
+
+    if (cache->num_buffers == SOLID_BUFFER_CACHE_SIZE) {
+        LOG_DEBUG("Solid buffer cache is full.");
+        return NULL;
+    }
+
+    struct wl_buffer *wl_buffer;
+    if (cache->single_pixel_buffer_mgr != NULL) {
+        // Components range from 0 to UINT32_MAX.
+        wl_buffer = wp_single_pixel_buffer_manager_v1_create_u32_rgba_buffer(
+            cache->single_pixel_buffer_mgr, premultiply(color, 24) * 0x01010101u,
+            premultiply(color, 16) * 0x01010101u,
+            premultiply(color, 8) * 0x01010101u, (color & 0xff) * 0x01010101u
+        );
+    } else {
+        wl_buffer = create_shm_buffer(cache, color);
+    }
+
+    if (wl_buffer == NULL) {
+        LOG_ERR("Could not create solid buffer.");
+        return NULL;
+    }
+
+    cache->buffers[cache->num_buffers++] = (struct solid_buffer){
+        .color     = color,
+        .wl_buffer = wl_buffer,
+    };
+    return wl_buffer;
+}
@@ -0,0 +1,50 @@
+#ifndef __SOLID_BUFFER_H_INCLUDED__
+#define __SOLID_BUFFER_H_INCLUDED__
+
+#include "shm_pool.h"
+#include "single-pixel-buffer-v1-client-protocol.h"
+
+#include <stdint.h>
+#include <wayland-client.h>
+
+#define SOLID_BUFFER_CACHE_SIZE 8
+
+struct solid_buffer {
+    uint32_t          color; // RGBA, like the configuration's colors
+    struct wl_buffer *wl_buffer;
+};
+
+/**
+ * 1x1 buffers of solid colors, meant to be stretched with a viewport. They are
+ * created with the single-pixel buffer protocol when the compositor supports
+ * it and in shared memory otherwise. As a buffer may be attached to several
+ * surfaces at once, buffers are only destroyed with the cache.
+ */
+struct solid_buffer_cache {
+    struct wp_single_pixel_buffer_manager_v1 *single_pixel_buffer_mgr;
+    struct wl_shm                            *wl_shm;
+
+    // Pixels of the buffers when they are in shared memory.
+    struct shm_pool shm;
+    ssize_t         shm_offset;
+    uint32_t       *shm_data;
+
+    int                 num_buffers;
+    struct solid_buffer buffers[SOLID_BUFFER_CACHE_SIZE];
+};
+
+void solid_buffer_cache_init(
+    struct solid_buffer_cache                *cache,
+    struct wp_single_pixel_buffer_manager_v1 *single_pixel_buffer_mgr,
+    struct wl_shm                            *wl_shm
+);
+void solid_buffer_cache_finish(struct solid_buffer_cache *cache);
+
+/**
+ * `solid_buffer_cache_get` returns a buffer filled with `color`. Returns NULL
+ * when the cache is full or upon error.
+ */
+struct wl_buffer *
+solid_buffer_cache_get(struct solid_buffer_cache *cache, uint32_t color);
+
+#endif
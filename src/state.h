@@ -1,10 +1,18 @@
 #ifndef __STATE_H_INCLUDED__
 #define __STATE_H_INCLUDED__
 
+#include "arena.h"
 #include "config.h"
+#include "event_loop.h"
 #include "fractional-scale-v1-client-protocol.h"
+#include "glyph_atlas.h"
+#include "input_buffer.h"
+#include "keysym_map.h"
 #include "label.h"
+#include "render_pool.h"
 #include "screencopy.h"
+#include "single-pixel-buffer-v1-client-protocol.h"
+#include "solid_buffer.h"
 #include "surface_buffer.h"
 #include "utils.h"
 #include "viewporter-client-protocol.h"
@@ -14,6 +22,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <wayland-client.h>
 #include <wayland-util.h>
 #include <xkbcommon/xkbcommon.h>
@@ -34,6 +43,9 @@
 // divisions each way.
 #define SPLIT_MAX_HISTORY 32
 
+// Keys typed before the first mode is entered, replayed once it is.
+#define TYPEAHEAD_MAX_KEYS 32
+
 #define MAX_NUM_MODES   3
 #define NO_MODE_ENTERED -1
 
@@ -52,6 +64,17 @@ struct tile_region {
     int         num_labels;   // rows * cols
 };
 
+/**
+ * Cells of tile mode indexed by label, computed once at enter. Coordinates are
+ * stored in separate arrays, in a single allocation starting at `x`.
+ */
+struct tile_layout {
+    int32_t *x;
+    int32_t *y;
+    int32_t *w;
+    int32_t *h;
+};
+
 struct tile_mode_state {
     // Region-based multi-output fields (set when all_outputs is true).
     // NULL in single-output mode.
@@ -69,8 +92,12 @@ struct tile_mode_state {
 
     label_selection_t *label_selection;
     label_symbols_t   *label_symbols;
+    struct keysym_map  symbol_map;
 
-    cairo_font_face_t *label_font_face;
+    struct tile_layout layout;
+
+    cairo_font_face_t       *label_font_face;
+    struct glyph_atlas_cache glyph_atlases;
 };
 
 struct floating_mode_state {
@@ -79,8 +106,10 @@ struct floating_mode_state {
 
     label_selection_t *label_selection;
     label_symbols_t   *label_symbols;
+    struct keysym_map  symbol_map;
 
-    cairo_font_face_t *label_font_face;
+    cairo_font_face_t       *label_font_face;
+    struct glyph_atlas_cache glyph_atlases;
 };
 
 struct bisect_mode_state {
@@ -95,8 +124,15 @@ struct split_mode_state {
     int         current;
 };
 
+struct typeahead_key {
+    uint32_t     time; // of the key event, in ms
+    xkb_keysym_t keysym;
+    char         text[8];
+};
+
 struct output {
     struct wl_list           link; // type: struct output
+    uint32_t                 global_name;
     struct wl_output        *wl_output;
     struct zxdg_output_v1   *xdg_output;
     char                    *name;
@@ -109,6 +145,41 @@ struct output {
 };
 
 struct state;
+struct keymap_cache;
+
+#define OVERLAY_NUM_BACKGROUND_PARTS 4
+
+struct speculative_frame {
+    bool        ready;
+    uint64_t    frame_id; // see `mode_frame_id`
+    struct rect content;  // the overlay's content rect for the frame
+    int32_t     scale_120;
+};
+
+/**
+ * Frame being rendered ahead, a band of rows at a time so that the events are
+ * handled in between.
+ */
+struct speculative_render {
+    int         slot; // in the speculation pool, -1 when none
+    int         candidate;
+    uint64_t    base_frame_id; // of the mode's state the candidate applies to
+    struct rect content;
+    int32_t     scale_120;
+    uint32_t    next_row; // first row of the buffer left to render
+    void       *data;     // of the buffer, to restart if it was reallocated
+};
+
+/**
+ * Subsurface showing a part of an overlay surface.
+ */
+struct overlay_part {
+    struct wl_surface    *wl_surface;
+    struct wl_subsurface *wl_subsurface;
+    struct wp_viewport   *wp_viewport;
+    struct rect           rect;      // in the coordinates the modes render in
+    struct wl_buffer     *wl_buffer; // attached solid buffer, if any
+};
 
 /**
  * Per-output overlay surface. In single-output mode there is exactly one of
@@ -122,13 +193,40 @@ struct overlay_surface {
     struct zwlr_layer_surface_v1  *wl_layer_surface;
     struct wp_viewport            *wp_viewport;
     struct wp_fractional_scale_v1 *fractional_scale;
-    struct surface_buffer_pool     surface_buffer_pool;
+    struct surface_buffer_pool     surface_buffer_pool; // for `content`
+    struct damage                  damage; // since the last commit
+
+    // The modes' rendering only covers the area where they draw more than
+    // their background. Around it, the background is stretched from solid
+    // buffers. The overlay surface itself is transparent.
+    struct overlay_part       content;
+    struct overlay_part       background[OVERLAY_NUM_BACKGROUND_PARTS];
+    struct solid_buffer_cache solid_buffers;
+
+    // Area the buffers of `content` are drawn for, which `content` shows a
+    // part of. It's kept while the content shrinks, e.g. as keys are typed,
+    // so that the buffers and their damage are reused.
+    struct rect buffer_area;
+    int         buffer_area_mode; // entered when it was set
+
+    // Frames rendered ahead for the next key presses, in the buffers of
+    // `speculation_pool` with the same indices.
+    struct surface_buffer_pool speculation_pool;
+    struct speculative_frame   speculative_frames[SURFACE_BUFFER_POOL_MAX_SIZE];
+    int                        next_candidate; // -1 when done
+    struct speculative_render  speculation;    // in progress
+
+    // Position of the surface in the coordinates the modes render in.
+    int32_t x;
+    int32_t y;
 
     uint32_t width;
     uint32_t height;
     uint32_t fractional_scale_val; // preferred scale * 120
 
     bool configured;
+    bool redraw_pending; // a frame is waiting for a buffer to be released
+    bool frame_due;      // to be sent with the others after dispatching
 
     struct output *output; // NULL until surface.enter fires (single-output, no -O)
     struct state  *state;
@@ -142,18 +240,33 @@ struct seat {
     struct xkb_keymap  *xkb_keymap;
     struct xkb_state   *xkb_state;
     struct state       *state;
+
+    // A cached keymap is kept as text, and only compiled once a key is
+    // pressed with modifiers.
+    struct keymap_cache *keymap_cache;
+    char                *keymap_text;
+    size_t               keymap_size;
+
+    // The last modifiers received, to apply them on a late compiled keymap.
+    uint32_t mods_depressed;
+    uint32_t mods_latched;
+    uint32_t mods_locked;
+    uint32_t group;
 };
 
 struct state {
-    struct config                           config;
-    struct wl_display                      *wl_display;
-    struct wl_registry                     *wl_registry;
-    struct wl_compositor                   *wl_compositor;
-    struct wl_shm                          *wl_shm;
-    struct zwlr_layer_shell_v1             *wl_layer_shell;
-    struct zwlr_virtual_pointer_manager_v1 *wl_virtual_pointer_mgr;
-    struct wp_viewporter                   *wp_viewporter;
-    struct wp_fractional_scale_manager_v1  *fractional_scale_mgr;
+    struct config                             config;
+    struct wl_display                        *wl_display;
+    struct event_loop                         event_loop;
+    struct wl_registry                       *wl_registry;
+    struct wl_compositor                     *wl_compositor;
+    struct wl_subcompositor                  *wl_subcompositor;
+    struct wl_shm                            *wl_shm;
+    struct zwlr_layer_shell_v1               *wl_layer_shell;
+    struct zwlr_virtual_pointer_manager_v1   *wl_virtual_pointer_mgr;
+    struct wp_viewporter                     *wp_viewporter;
+    struct wp_fractional_scale_manager_v1    *fractional_scale_mgr;
+    struct wp_single_pixel_buffer_manager_v1 *single_pixel_buffer_mgr;
 #if OPENCV_ENABLED
     struct zwlr_screencopy_manager_v1 *wl_screencopy_manager;
 #endif
@@ -161,17 +274,27 @@ struct state {
     struct wl_list                 outputs;
     struct wl_list                 seats;
     struct wl_list                 overlay_surfaces; // type: struct overlay_surface
+    struct render_pool             render_pool;      // renders the overlays
     struct output                 *current_output;   // set from -O/-r or surface.enter (single-output);
                                                      // set from result coords (all-outputs) before move_pointer
     bool                           running;
     struct rect                    initial_area;
     char                           home_row_buffer[HOME_ROW_BUFFER_LEN];
+    char                          *keymap_home_row[HOME_ROW_LEN_WITH_BTN];
+    bool                           keymap_home_row_invalid;
     char                         **home_row;
+    struct keysym_map              home_row_map;
+    FILE                          *input; // areas source for the floating mode
+    struct input_buffer            input_buffer; // read from `input` ahead
     struct rect                    result;
     struct mode_interface         *mode_interfaces[MAX_NUM_MODES];
     void                          *mode_states[MAX_NUM_MODES];
+    struct arena                   mode_arena;
+    struct arena_mark              mode_marks[MAX_NUM_MODES]; // at each enter
     int                            current_mode;
     enum click                     click;
+    struct typeahead_key           typeahead[TYPEAHEAD_MAX_KEYS];
+    int                            num_typeahead;
 };
 
 #endif
@@ -1,46 +1,21 @@
 #include "surface_buffer.h"
 
 #include "log.h"
+#include "utils.h"
 
 #include <cairo/cairo.h>
-#include <errno.h>
-#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
-#include <unistd.h>
 
 #define CAIRO_SURFACE_FORMAT CAIRO_FORMAT_ARGB32
 
-static int create_shm_file(void) {
-    char name[] = "/tmp/wl-shm-XXXXXX";
-    int  fd     = mkostemp(name, O_CLOEXEC);
-    if (fd < 0) {
-        return -1;
-    }
-
-    unlink(name);
-    return fd;
-}
-
-int allocate_shm_file(size_t size) {
-    int fd = create_shm_file();
-    if (fd < 0) {
-        return -1;
-    }
+static void handle_buffer_release(void *data, struct wl_buffer *wl_buffer) {
+    struct surface_buffer *buffer = data;
+    buffer->state                 = SURFACE_BUFFER_READY;
 
-    int err;
-    while ((err = ftruncate(fd, size)) && errno == EINTR) {}
-    if (err) {
-        close(fd);
-        return -1;
+    if (buffer->pool->release != NULL) {
+        buffer->pool->release(buffer->pool->release_data);
     }
-
-    return fd;
-}
-
-static void handle_buffer_release(void *data, struct wl_buffer *wl_buffer) {
-    ((struct surface_buffer *)data)->state = SURFACE_BUFFER_READY;
 }
 
 static const struct wl_buffer_listener wl_buffer_listener = {
@@ -48,42 +23,34 @@ static const struct wl_buffer_listener wl_buffer_listener = {
 };
 
 static struct surface_buffer *surface_buffer_init(
-    struct wl_shm *wl_shm, struct surface_buffer *buffer, int32_t width,
-    int32_t height
+    struct wl_shm *wl_shm, struct surface_buffer_pool *pool,
+    struct surface_buffer *buffer, int32_t width, int32_t height
 ) {
     const uint32_t stride =
         cairo_format_stride_for_width(CAIRO_SURFACE_FORMAT, width);
     const uint32_t data_size = height * stride;
     void          *data;
 
-    int fd = allocate_shm_file(data_size);
-    if (fd < 0) {
+    ssize_t offset = shm_pool_alloc(&pool->shm, wl_shm, data_size, &data);
+    if (offset < 0) {
         LOG_ERR("Could not allocate shared buffer for surface buffer.");
         return NULL;
     }
 
-    data = mmap(NULL, data_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (data == MAP_FAILED) {
-        LOG_ERR("Could not mmap shared buffer for surface buffer.");
-
-        close(fd);
-        return NULL;
-    }
-
-    struct wl_shm_pool *wl_shm_pool = wl_shm_create_pool(wl_shm, fd, data_size);
-    buffer->wl_buffer               = wl_shm_pool_create_buffer(
-        wl_shm_pool, 0, width, height, stride, WL_SHM_FORMAT_ARGB8888
+    buffer->wl_buffer = wl_shm_pool_create_buffer(
+        pool->shm.wl_shm_pool, offset, width, height, stride,
+        WL_SHM_FORMAT_ARGB8888
     );
     wl_buffer_add_listener(buffer->wl_buffer, &wl_buffer_listener, buffer);
-    wl_shm_pool_destroy(wl_shm_pool);
-
-    close(fd);
 
-    buffer->data      = data;
-    buffer->data_size = data_size;
-    buffer->width     = width;
-    buffer->height    = height;
-    buffer->state     = SURFACE_BUFFER_READY;
+    buffer->pool        = pool;
+    buffer->data        = data;
+    buffer->data_offset = offset;
+    buffer->data_size   = data_size;
+    buffer->width       = width;
+    buffer->height      = height;
+    buffer->state       = SURFACE_BUFFER_READY;
+    damage_set_full(&buffer->damage);
 
     buffer->cairo_surface = cairo_image_surface_create_for_data(
         buffer->data, CAIRO_SURFACE_FORMAT, width, height, stride
@@ -111,35 +78,122 @@ static void surface_buffer_destroy(struct surface_buffer *buffer) {
     }
 
     if (buffer->data) {
-        munmap(buffer->data, buffer->data_size);
+        shm_pool_free(&buffer->pool->shm, buffer->data_offset, buffer->data);
     }
 
     memset(buffer, 0, sizeof(struct surface_buffer));
 }
 
-void surface_buffer_pool_init(struct surface_buffer_pool *pool) {
+void surface_buffer_pool_init(
+    struct surface_buffer_pool *pool, int size, bool prefault,
+    void (*release)(void *data), void *release_data
+) {
     memset(pool, 0, sizeof(struct surface_buffer_pool));
+    shm_pool_init(&pool->shm, prefault);
+    pool->size         = min(max(size, 1), SURFACE_BUFFER_POOL_MAX_SIZE);
+    pool->release      = release;
+    pool->release_data = release_data;
 }
 
 void surface_buffer_pool_destroy(struct surface_buffer_pool *pool) {
-    surface_buffer_destroy(&pool->buffers[0]);
-    surface_buffer_destroy(&pool->buffers[1]);
+    for (int i = 0; i < pool->size; i++) {
+        surface_buffer_destroy(&pool->buffers[i]);
+    }
+
+    shm_pool_finish(&pool->shm);
+}
+
+void surface_buffer_pool_add_damage(
+    struct surface_buffer_pool *pool, struct damage *damage
+) {
+    for (int i = 0; i < pool->size; i++) {
+        damage_add_damage(&pool->buffers[i].damage, damage);
+    }
+}
+
+size_t surface_buffer_pool_shm_size(struct surface_buffer_pool *pool) {
+    size_t size = 0;
+    for (int i = 0; i < pool->size; i++) {
+        size += pool->buffers[i].data_size;
+    }
+
+    return size;
+}
+
+struct surface_buffer *surface_buffer_pool_next(
+    struct surface_buffer_pool *pool, uint32_t width, uint32_t height
+) {
+    struct surface_buffer *ready = NULL, *uninitialized = NULL;
+    for (int i = 0; i < pool->size; i++) {
+        struct surface_buffer *buffer = &pool->buffers[i];
+        if (buffer->state == SURFACE_BUFFER_READY) {
+            if (buffer->width == width && buffer->height == height) {
+                return buffer;
+            }
+            if (ready == NULL) {
+                ready = buffer;
+            }
+        } else if (buffer->state == SURFACE_BUFFER_UNINITIALIZED &&
+                   uninitialized == NULL) {
+            uninitialized = buffer;
+        }
+    }
+
+    return ready != NULL ? ready : uninitialized;
+}
+
+int surface_buffer_pool_release_idle(struct surface_buffer_pool *pool) {
+    struct surface_buffer *last_used = NULL;
+    for (int i = 0; i < pool->size; i++) {
+        struct surface_buffer *buffer = &pool->buffers[i];
+        if (buffer->state != SURFACE_BUFFER_UNINITIALIZED &&
+            (last_used == NULL || buffer->last_used > last_used->last_used)) {
+            last_used = buffer;
+        }
+    }
+
+    uint64_t now     = now_ms();
+    int      next_in = -1;
+    for (int i = 0; i < pool->size; i++) {
+        struct surface_buffer *buffer = &pool->buffers[i];
+        if (buffer == last_used || buffer->state != SURFACE_BUFFER_READY) {
+            continue;
+        }
+
+        uint64_t idle = now - buffer->last_used;
+        if (idle >= SURFACE_BUFFER_IDLE_TIMEOUT_MS) {
+            LOG_DEBUG("Releasing idle surface buffer.");
+            surface_buffer_destroy(buffer);
+        } else {
+            int remaining = SURFACE_BUFFER_IDLE_TIMEOUT_MS - idle;
+            next_in = next_in < 0 ? remaining : min(next_in, remaining);
+        }
+    }
+
+    return next_in;
 }
 
 struct surface_buffer *get_next_buffer(
     struct wl_shm *wl_shm, struct surface_buffer_pool *pool, uint32_t width,
     uint32_t height
 ) {
-    struct surface_buffer *buffer = NULL;
-    for (size_t i = 0; i < 2; i++) {
-        if (pool->buffers[i].state != SURFACE_BUFFER_BUSY) {
-            buffer = &pool->buffers[i];
-            break;
-        }
+    struct surface_buffer *buffer =
+        surface_buffer_pool_next(pool, width, height);
+    if (buffer == NULL) {
+        // The caller is expected to retry once a buffer is released.
+        LOG_DEBUG("All surface buffers are busy.");
+        return NULL;
     }
 
-    if (buffer == NULL) {
-        LOG_WARN("All surface buffers are busy.");
+    return get_buffer(wl_shm, pool, buffer - pool->buffers, width, height);
+}
+
+struct surface_buffer *get_buffer(
+    struct wl_shm *wl_shm, struct surface_buffer_pool *pool, int idx,
+    uint32_t width, uint32_t height
+) {
+    struct surface_buffer *buffer = &pool->buffers[idx];
+    if (buffer->state == SURFACE_BUFFER_BUSY) {
         return NULL;
     }
 
@@ -148,11 +202,13 @@ struct surface_buffer *get_next_buffer(
     }
 
     if (buffer->state == SURFACE_BUFFER_UNINITIALIZED) {
-        if (surface_buffer_init(wl_shm, buffer, width, height) == NULL) {
+        if (surface_buffer_init(wl_shm, pool, buffer, width, height) ==
+            NULL) {
             LOG_ERR("Could not initialize next buffer.");
             return NULL;
         }
     }
 
+    buffer->last_used = now_ms();
     return buffer;
 }
@@ -1,9 +1,17 @@
 #ifndef __SURFACE_BUFFER_H_INCLUDED__
 #define __SURFACE_BUFFER_H_INCLUDED__
 
+#include "damage.h"
+#include "shm_pool.h"
+
 #include <cairo/cairo.h>
 #include <wayland-client.h>
 
+#define SURFACE_BUFFER_POOL_MAX_SIZE 4
+
+// Time after which a buffer that isn't used is freed.
+#define SURFACE_BUFFER_IDLE_TIMEOUT_MS 3000
+
 enum surface_buffer_state {
     // This must be set to 0 as we set the whole structure to 0 when it's not
     // initialized.
@@ -13,29 +21,76 @@ enum surface_buffer_state {
     SURFACE_BUFFER_BUSY  = 2,
 };
 
+struct surface_buffer_pool;
+
 struct surface_buffer {
-    enum surface_buffer_state state;
+    enum surface_buffer_state   state;
+    struct surface_buffer_pool *pool;
     struct wl_buffer         *wl_buffer;
     cairo_surface_t          *cairo_surface;
     cairo_t                  *cairo;
     void                     *data;
+    size_t                    data_offset; // in the pool's shm
     size_t                    data_size;
     uint32_t                  width;
     uint32_t                  height;
+    uint64_t                  last_used; // see `now_ms`
+
+    // Areas rendered since this buffer was last drawn.
+    struct damage damage;
 };
 
 struct surface_buffer_pool {
-    struct surface_buffer buffers[2];
+    struct surface_buffer buffers[SURFACE_BUFFER_POOL_MAX_SIZE];
+    int                   size;
+    struct shm_pool       shm;
+
+    // Called when the compositor releases one of the buffers.
+    void (*release)(void *data);
+    void *release_data;
 };
 
-void surface_buffer_pool_init(struct surface_buffer_pool *pool);
+void surface_buffer_pool_init(
+    struct surface_buffer_pool *pool, int size, bool prefault,
+    void (*release)(void *data), void *release_data
+);
 void surface_buffer_pool_destroy(struct surface_buffer_pool *pool);
 
+// Mark the given areas as outdated in all the pool's buffers.
+void surface_buffer_pool_add_damage(
+    struct surface_buffer_pool *pool, struct damage *damage
+);
+
+// Total size of the pool's allocated buffers in bytes.
+size_t surface_buffer_pool_shm_size(struct surface_buffer_pool *pool);
+
+/**
+ * `surface_buffer_pool_next` returns the buffer `get_next_buffer` would use for
+ * a `width` x `height` frame or NULL if they are all busy. A released buffer of
+ * that size is preferred, then any released one. Another buffer is only
+ * allocated when all the others are held by the compositor.
+ */
+struct surface_buffer *surface_buffer_pool_next(
+    struct surface_buffer_pool *pool, uint32_t width, uint32_t height
+);
+
+/**
+ * `surface_buffer_pool_release_idle` frees the buffers that haven't been used
+ * for `SURFACE_BUFFER_IDLE_TIMEOUT_MS`, except the last used one. Returns the
+ * time in ms until the next buffer may become idle or -1 if none may.
+ */
+int surface_buffer_pool_release_idle(struct surface_buffer_pool *pool);
+
 struct surface_buffer *get_next_buffer(
     struct wl_shm *wl_shm, struct surface_buffer_pool *pool, uint32_t width,
     uint32_t height
 );
 
-int allocate_shm_file(size_t size);
+// Same as `get_next_buffer` for the pool's `idx`-th buffer. Returns NULL when
+// it's busy.
+struct surface_buffer *get_buffer(
+    struct wl_shm *wl_shm, struct surface_buffer_pool *pool, int idx,
+    uint32_t width, uint32_t height
+);
 
 #endif
@@ -136,6 +136,51 @@ int main() {
         }
     }
 
+    // The matching labels must be the ones including the selection.
+    label_selection_t *curr_label = label_selection_new(label_symbols, 100);
+    int                selections[][2] = {{-1, -1}, {3, -1}, {0, 4}, {4, 3}};
+    for (int s = 0; s < sizeof(selections) / sizeof(selections[0]); s++) {
+        label_selection_clear(label_selection);
+        for (int i = 0; i < 2 && selections[s][i] >= 0; i++) {
+            label_selection_append(label_selection, selections[s][i]);
+        }
+
+        int first, stride;
+        label_selection_matching(label_selection, &first, &stride);
+
+        for (int i = 0; i < 100; i++) {
+            label_selection_set_from_idx(curr_label, i);
+            bool included =
+                label_selection_is_included(curr_label, label_selection);
+            bool matching = i >= first && (i - first) % stride == 0;
+            if (included != matching) {
+                LOG_ERR(
+                    "Label %d matching (%d) but included (%d) for selection "
+                    "%d.",
+                    i, matching, included, s
+                );
+                return 15;
+            }
+        }
+    }
+    label_selection_free(curr_label);
+
+    // In prefix order, the labels starting with a symbol must be contiguous.
+    int order[100];
+    int num_ordered =
+        label_selection_prefix_order(label_selection, 10, 90, order);
+    if (num_ordered != 80) {
+        LOG_ERR("Wrong number of ordered labels %d.", num_ordered);
+        return 16;
+    }
+    for (int i = 1; i < num_ordered; i++) {
+        if (order[i] < 10 || order[i] >= 90 ||
+            order[i] % 5 < order[i - 1] % 5) {
+            LOG_ERR("Label %d out of order at %d.", order[i], i);
+            return 17;
+        }
+    }
+
     label_selection_free(label_selection);
     label_symbols_free(label_symbols);
     return 0;
@@ -0,0 +1,38 @@
+#include "log.h"
+#include "src/utils.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+int main() {
+    // Both curves must go through each cell exactly once, and consecutive
+    // cells along the Hilbert curve must be neighbours.
+    bool hilbert_hit[64] = {false};
+    bool z_hit[64]       = {false};
+    int  curve_x[64], curve_y[64];
+    for (uint32_t x = 0; x < 8; x++) {
+        for (uint32_t y = 0; y < 8; y++) {
+            uint64_t i = hilbert_curve_idx(3, x, y);
+            uint64_t j = z_curve_idx(x, y);
+            if (i >= 64 || hilbert_hit[i] || j >= 64 || z_hit[j]) {
+                LOG_ERR("Curve index of %ux%u out of range or taken.", x, y);
+                return 1;
+            }
+
+            hilbert_hit[i] = true;
+            z_hit[j]       = true;
+            curve_x[i]     = x;
+            curve_y[i]     = y;
+        }
+    }
+    for (int i = 1; i < 64; i++) {
+        if (abs(curve_x[i] - curve_x[i - 1]) +
+                abs(curve_y[i] - curve_y[i - 1]) !=
+            1) {
+            LOG_ERR("Hilbert curve jumps at %d.", i);
+            return 2;
+        }
+    }
+
+    return 0;
+}
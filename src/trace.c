@@ -0,0 +1,127 @@
+#include "trace.h"
+
+#include "log.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct trace_event {
+    const char *name;
+    uint64_t    ts;
+    uint64_t    dur;
+    int         tid;
+    char        phase; // 'X' for complete events, 'i' for instant ones
+};
+
+// Events may be recorded from the render threads.
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct {
+    char               *path;
+    struct trace_event *events;
+    size_t              len;
+    size_t              cap;
+} trace = {0};
+
+void trace_open(const char *path) {
+    free(trace.path);
+    trace.path = strdup(path);
+}
+
+bool trace_enabled(void) {
+    return trace.path != NULL;
+}
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void trace_push(const char *name, char phase, uint64_t ts, uint64_t dur) {
+    if (!trace_enabled()) {
+        return;
+    }
+
+    pthread_mutex_lock(&trace_mutex);
+    if (trace.len >= trace.cap) {
+        trace.cap    = trace.cap == 0 ? 256 : trace.cap * 2;
+        trace.events = realloc(trace.events, trace.cap * sizeof(*trace.events));
+    }
+
+    trace.events[trace.len++] = (struct trace_event){
+        .name  = name,
+        .ts    = ts,
+        .dur   = dur,
+        .tid   = gettid(),
+        .phase = phase,
+    };
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+void trace_complete(const char *name, uint64_t start) {
+    uint64_t now = trace_now();
+    trace_push(name, 'X', start, now - start);
+}
+
+void trace_instant(const char *name) {
+    trace_push(name, 'i', trace_now(), 0);
+}
+
+void trace_write(void) {
+    if (!trace_enabled()) {
+        return;
+    }
+
+    FILE *f = fopen(trace.path, "w");
+    if (f == NULL) {
+        LOG_ERR("Could not open trace file '%s'.", trace.path);
+        return;
+    }
+
+    int pid = getpid();
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+    fprintf(
+        f,
+        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+        "\"args\":{\"name\":\"wl-kbptr\"}}",
+        pid, pid
+    );
+
+    for (size_t i = 0; i < trace.len; i++) {
+        struct trace_event *e = &trace.events[i];
+        fprintf(
+            f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lu,", e->name,
+            e->phase, (unsigned long)e->ts
+        );
+
+        if (e->phase == 'X') {
+            fprintf(f, "\"dur\":%lu,", (unsigned long)e->dur);
+        } else {
+            fputs("\"s\":\"p\",", f);
+        }
+
+        fprintf(f, "\"pid\":%d,\"tid\":%d}", pid, e->tid);
+    }
+
+    fputs("\n]}\n", f);
+    fclose(f);
+
+    // Each write only holds the events recorded since the previous one.
+    pthread_mutex_lock(&trace_mutex);
+    trace.len = 0;
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+void trace_close(void) {
+    trace_write();
+
+    free(trace.events);
+    free(trace.path);
+    memset(&trace, 0, sizeof(trace));
+}
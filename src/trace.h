@@ -0,0 +1,44 @@
+#ifndef __TRACE_H_INCLUDED__
+#define __TRACE_H_INCLUDED__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Phase tracing. Events are kept in memory and written as trace event JSON
+ * which can be loaded in Perfetto (https://ui.perfetto.dev) or
+ * `chrome://tracing`.
+ *
+ * Event names must be string literals as they are not copied.
+ */
+
+// Enable tracing. Events will be written to the file at `path`.
+void trace_open(const char *path);
+
+bool trace_enabled(void);
+
+// Current monotonic time in microseconds.
+uint64_t trace_now(void);
+
+// Record a phase that started at `start` (from `trace_now`) and ends now.
+void trace_complete(const char *name, uint64_t start);
+
+// Record a point in time.
+void trace_instant(const char *name);
+
+// Write the events recorded since the last write to the trace file, replacing
+// its content.
+void trace_write(void);
+
+// Write the trace file and free the recorded events.
+void trace_close(void);
+
+#define TRACE_BEGIN(var) uint64_t var = trace_enabled() ? trace_now() : 0
+#define TRACE_END(name, var)            \
+    do {                                \
+        if (trace_enabled()) {          \
+            trace_complete(name, var);  \
+        }                               \
+    } while (0)
+
+#endif
@@ -1,5 +1,8 @@
+#include "utils.h"
+
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 int min(int a, int b) {
     return a < b ? a : b;
@@ -9,6 +12,87 @@ int max(int a, int b) {
     return a > b ? a : b;
 }
 
+uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+uint64_t hilbert_curve_idx(int bits, uint32_t x, uint32_t y) {
+    uint32_t n   = 1u << bits;
+    uint64_t idx = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        idx += (uint64_t)s * s * ((3 * rx) ^ ry);
+
+        // Rotate the quadrant so that the sub-curve starts at its origin.
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+
+            uint32_t t = x;
+            x          = y;
+            y          = t;
+        }
+    }
+
+    return idx;
+}
+
+uint64_t z_curve_idx(uint32_t x, uint32_t y) {
+    uint64_t idx = 0;
+    for (int i = 0; i < 32; i++) {
+        idx |= (uint64_t)((x >> i) & 1) << (2 * i);
+        idx |= (uint64_t)((y >> i) & 1) << (2 * i + 1);
+    }
+
+    return idx;
+}
+
+uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+struct rect rect_union(struct rect a, struct rect b) {
+    int32_t x0 = min(a.x, b.x);
+    int32_t y0 = min(a.y, b.y);
+    int32_t x1 = max(a.x + a.w, b.x + b.w);
+    int32_t y1 = max(a.y + a.h, b.y + b.h);
+
+    return (struct rect){.x = x0, .y = y0, .w = x1 - x0, .h = y1 - y0};
+}
+
+struct rect rect_intersection(struct rect a, struct rect b) {
+    int32_t x0 = max(a.x, b.x);
+    int32_t y0 = max(a.y, b.y);
+    int32_t x1 = min(a.x + a.w, b.x + b.w);
+    int32_t y1 = min(a.y + a.h, b.y + b.h);
+
+    if (x1 <= x0 || y1 <= y0) {
+        return (struct rect){.x = x0, .y = y0, .w = 0, .h = 0};
+    }
+
+    return (struct rect){.x = x0, .y = y0, .w = x1 - x0, .h = y1 - y0};
+}
+
+int rect_intersects(struct rect a, struct rect b) {
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h &&
+           b.y < a.y + a.h;
+}
+
+int rect_equals(struct rect a, struct rect b) {
+    return a.x == b.x && a.y == b.y && a.w == b.w && a.h == b.h;
+}
+
 int str_to_rune(char *str, uint32_t *rune) {
     unsigned char *c = ((unsigned char *)str);
 
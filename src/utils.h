@@ -20,6 +20,31 @@ enum click {
 
 int max(int a, int b);
 int min(int a, int b);
+
+// Smallest rect containing both `a` and `b`.
+struct rect rect_union(struct rect a, struct rect b);
+
+// Returns a rect of size 0 if `a` and `b` don't overlap.
+struct rect rect_intersection(struct rect a, struct rect b);
+
+int rect_intersects(struct rect a, struct rect b);
+int rect_equals(struct rect a, struct rect b);
+
+// Continues the FNV-1a hash `hash` with `len` bytes at `data`. Start with
+// `FNV1A_INIT`.
+#define FNV1A_INIT 0xcbf29ce484222325ull
+uint64_t fnv1a(uint64_t hash, const void *data, size_t len);
+
+// Position of (`x`, `y`) along the Hilbert curve filling the square of side
+// `1 << bits`.
+uint64_t hilbert_curve_idx(int bits, uint32_t x, uint32_t y);
+
+// Position of (`x`, `y`) along the Z-order curve, i.e. their interleaved bits.
+uint64_t z_curve_idx(uint32_t x, uint32_t y);
+
+// Milliseconds elapsed on the monotonic clock.
+uint64_t now_ms(void);
+
 int find_str(char **strs, size_t len, char *to_find);
 
 // Extract first rune (32 bit UTF-8 code) in string.